@@ -0,0 +1,73 @@
+#include "BitStream.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+uint32_t Quantizer::encode(float value) const
+{
+    float q = std::round((value - min) / step);
+    // (also catches NaN)
+    if (!(q > 0.0f))
+        return 0;
+    if (q >= float(top()))
+        return top();
+    return uint32_t(q);
+}
+
+void BitWriter::write(uint32_t value, uint32_t bits)
+{
+    assert(bits <= 32);
+    assert(bits == 32 || (value >> bits) == 0);
+    scratch |= uint64_t(value) << scratch_bits;
+    scratch_bits += bits;
+    while (scratch_bits >= 8)
+    {
+        buffer.push_back(uint8_t(scratch));
+        scratch >>= 8;
+        scratch_bits -= 8;
+    }
+}
+
+void BitWriter::write_varbits(uint32_t value)
+{
+    uint32_t width = 0;
+    while (width < 32 && (value >> width) != 0)
+        width += 1;
+    write(width, 6);
+    write(value, width);
+}
+
+void BitWriter::flush()
+{
+    if (scratch_bits > 0)
+        buffer.push_back(uint8_t(scratch));
+    scratch = 0;
+    scratch_bits = 0;
+}
+
+uint32_t BitReader::read(uint32_t bits)
+{
+    assert(bits <= 32);
+    while (scratch_bits < bits)
+    {
+        if (at >= end)
+            throw std::runtime_error("Ran out of bytes reading bit-packed message.");
+        scratch |= uint64_t(buffer[at]) << scratch_bits;
+        at += 1;
+        scratch_bits += 8;
+    }
+    uint32_t value = uint32_t(scratch & ((uint64_t(1) << bits) - 1));
+    scratch >>= bits;
+    scratch_bits -= bits;
+    return value;
+}
+
+uint32_t BitReader::read_varbits()
+{
+    uint32_t width = read(6);
+    if (width > 32)
+        throw std::runtime_error("Bad width " + std::to_string(width) + " in bit-packed message.");
+    return read(width);
+}
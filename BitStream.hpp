@@ -0,0 +1,86 @@
+#pragma once
+
+#include "ByteQueue.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Fixed-point encoding of a float: 'bits' steps of size 'step' starting at 'min'.
+ * Values outside [min, max()] are clamped; values on the grid (including zero, if min is a multiple of step)
+ * come back exactly.
+ */
+struct Quantizer
+{
+    float min;
+    float step;
+    uint32_t bits;
+
+    constexpr uint32_t top() const { return uint32_t((uint64_t(1) << bits) - 1); }
+    constexpr float max() const { return min + step * float(top()); }
+
+    uint32_t encode(float value) const;
+    float decode(uint32_t q) const { return min + step * float(q); }
+    // what the other end will see after encode/decode:
+    float round_trip(float value) const { return decode(encode(value)); }
+};
+
+/**
+ * Appends values to a byte queue (usually Connection::send_buffer) a few bits at a time,
+ * least significant bit first. Call flush() when done to pad out the last byte.
+ */
+struct BitWriter
+{
+    explicit BitWriter(ByteQueue &buffer_) : buffer(buffer_) {}
+
+    // write the low 'bits' (<= 32) bits of 'value':
+    void write(uint32_t value, uint32_t bits);
+    void write(bool value) { write(value ? 1u : 0u, 1); }
+    // small values in few bits: a 6-bit width, then that many bits
+    void write_varbits(uint32_t value);
+    void write(Quantizer const &q, float value) { write(q.encode(value), q.bits); }
+    void write(Quantizer const &qx, Quantizer const &qy, glm::vec2 value)
+    {
+        write(qx, value.x);
+        write(qy, value.y);
+    }
+
+    // write any partial byte (zero-padded) to the buffer:
+    void flush();
+
+    ByteQueue &buffer;
+    uint64_t scratch = 0;
+    uint32_t scratch_bits = 0;
+};
+
+/**
+ * Reads what a BitWriter wrote from 'size' bytes of memory
+ * (usually a message in Connection::recv_buffer, via ByteQueue::contiguous).
+ * Throws std::runtime_error instead of reading past the end.
+ */
+struct BitReader
+{
+    BitReader(uint8_t const *buffer_, size_t size) : buffer(buffer_), at(0), end(size) {}
+
+    uint32_t read(uint32_t bits);
+    bool read_bool() { return read(1) != 0; }
+    uint32_t read_varbits();
+    float read(Quantizer const &q) { return q.decode(read(q.bits)); }
+    glm::vec2 read(Quantizer const &qx, Quantizer const &qy)
+    {
+        float x = read(qx);
+        return glm::vec2(x, read(qy));
+    }
+
+    // true if every byte was consumed and the padding in the last one was zero:
+    bool at_end() const { return at == end && scratch == 0; }
+
+    uint8_t const *buffer;
+    size_t at;
+    size_t end;
+    uint64_t scratch = 0;
+    uint32_t scratch_bits = 0;
+};
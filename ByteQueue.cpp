@@ -0,0 +1,69 @@
+#include "ByteQueue.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void ByteQueue::reserve(size_t size) {
+	if (size <= bytes.size()) return;
+	size_t grown = std::max< size_t >(bytes.size(), 256);
+	while (grown < size) grown *= 2;
+
+	//move the contents to the front of the new storage:
+	std::vector< uint8_t > storage(grown);
+	copy(0, count, storage.data());
+	bytes.swap(storage);
+	mask = bytes.size() - 1;
+	head = 0;
+}
+
+void ByteQueue::append(void const *data_, size_t size) {
+	if (size == 0) return;
+	reserve(count + size);
+	uint8_t const *data = reinterpret_cast< uint8_t const * >(data_);
+	size_t tail = (head + count) & mask;
+	size_t first = std::min(size, bytes.size() - tail);
+	std::memcpy(bytes.data() + tail, data, first);
+	std::memcpy(bytes.data(), data + first, size - first);
+	count += size;
+}
+
+void ByteQueue::append(ByteQueue const &from, size_t begin, size_t size) {
+	assert(&from != this);
+	View runs[2];
+	uint32_t n = from.views(begin, size, runs);
+	for (uint32_t i = 0; i < n; ++i) {
+		append(runs[i].data, runs[i].size);
+	}
+}
+
+void ByteQueue::copy(size_t begin, size_t size, void *out_) const {
+	uint8_t *out = reinterpret_cast< uint8_t * >(out_);
+	View runs[2];
+	uint32_t n = views(begin, size, runs);
+	for (uint32_t i = 0; i < n; ++i) {
+		std::memcpy(out, runs[i].data, runs[i].size);
+		out += runs[i].size;
+	}
+}
+
+uint8_t *ByteQueue::contiguous(size_t begin, size_t size) {
+	assert(begin + size <= count);
+	if (bytes.empty()) return nullptr;
+	if (((head + begin) & mask) + size > bytes.size()) {
+		//wraps around the end of storage, so rotate the contents back to the front:
+		std::rotate(bytes.begin(), bytes.begin() + head, bytes.end());
+		head = 0;
+	}
+	return bytes.data() + ((head + begin) & mask);
+}
+
+uint32_t ByteQueue::views(size_t begin, size_t size, View (&out)[2]) const {
+	assert(begin + size <= count);
+	if (size == 0) return 0;
+	size_t at = (head + begin) & mask;
+	size_t first = std::min(size, bytes.size() - at);
+	out[0] = View{bytes.data() + at, first};
+	if (first == size) return 1;
+	out[1] = View{bytes.data(), size - first};
+	return 2;
+}
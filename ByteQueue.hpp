@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+//First-in, first-out bytes for Connection's send_buffer and recv_buffer:
+// a growable ring, so appending at the back and consuming from the front are both O(1)
+// (a std::vector would have to move everything behind the consumed bytes).
+//Indices are relative to the front; a message that straddles the end of the ring can be
+// made contiguous with 'contiguous' (which rotates the storage, but only when needed).
+struct ByteQueue {
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	size_t capacity() const { return bytes.size(); }
+
+	uint8_t &operator[](size_t i) { assert(i < count); return bytes[(head + i) & mask]; }
+	uint8_t const &operator[](size_t i) const { assert(i < count); return bytes[(head + i) & mask]; }
+
+	void push_back(uint8_t byte) {
+		if (count == bytes.size()) reserve(count + 1);
+		bytes[(head + count) & mask] = byte;
+		count += 1;
+	}
+	void append(void const *data, size_t size);
+	//append bytes [begin, begin+size) of another queue:
+	void append(ByteQueue const &from, size_t begin, size_t size);
+
+	//drop the first 'size' bytes:
+	void consume(size_t size) {
+		assert(size <= count);
+		count -= size;
+		//(an empty queue starts over at the front of storage, so the next messages won't wrap)
+		head = (count == 0 ? 0 : (head + size) & mask);
+	}
+	//drop all but the first 'size' bytes:
+	void truncate(size_t size) {
+		assert(size <= count);
+		count = size;
+		if (count == 0) head = 0;
+	}
+	void clear() { head = 0; count = 0; }
+
+	//make room for at least 'size' bytes without further allocation:
+	void reserve(size_t size);
+
+	//copy bytes [begin, begin+size) out:
+	void copy(size_t begin, size_t size, void *out) const;
+
+	//pointer to bytes [begin, begin+size) as one run of memory (rotating the storage first if they wrap):
+	uint8_t *contiguous(size_t begin, size_t size);
+
+	//bytes [begin, begin+size) as at most two runs of memory (e.g., for writev/sendmsg); returns how many runs:
+	struct View {
+		uint8_t const *data;
+		size_t size;
+	};
+	uint32_t views(size_t begin, size_t size, View (&out)[2]) const;
+
+	//internals:
+	std::vector< uint8_t > bytes; //storage; size is zero or a power of two
+	size_t mask = 0; //bytes.size() - 1
+	size_t head = 0; //index of the first byte
+	size_t count = 0; //bytes in the queue
+};
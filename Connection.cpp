@@ -20,16 +20,23 @@ typedef int ssize_t;
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <netinet/ip.h>
 #include <unistd.h>
 #include <netdb.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <fcntl.h>
+#endif
+
 #define closesocket close
 
 #endif
 
 #include "Connection.hpp"
+#include "Wire.hpp"
 
 //------------------------------------------------------
 
@@ -37,6 +44,7 @@ typedef int ssize_t;
 #include <cmath>
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstring>
 
 //NOTE: much of the sockets code herein is based on http-tweak's single-header http server
@@ -45,22 +53,397 @@ typedef int ssize_t;
 //Also, some help and examples for getaddrinfo from: https://beej.us/guide/bgnet/html/multi/syscalls.html
 
 
+//---------------------------------
+//UDP helpers (see Transport in Connection.hpp):
+
+namespace {
+	//first byte of every datagram:
+	enum : uint8_t {
+		UdpHello = 'H', //client -> server: open a connection (repeated until welcomed)
+		UdpWelcome = 'W', //server -> client: the connection is open
+		UdpBye = 'B', //either way: the connection is closed
+		UdpSegment = 'R', //[sequence:4][data...] a piece of the reliable stream
+		UdpAck = 'A', //[next expected sequence:4] also serves as a keepalive
+		UdpLatest = 'L', //[sequence:4][fragment:2][fragment count:2][data...] a piece of a latest-only message
+	};
+	//keep datagrams under the IPv6 minimum MTU, less headers, so they never get fragmented by IP:
+	constexpr size_t MaxDatagram = 1200;
+	constexpr size_t SegmentHeader = 5;
+	constexpr size_t LatestHeader = 9;
+	constexpr double ResendAfter = 0.2; //seconds before an unacknowledged segment goes out again
+	constexpr size_t MaxInFlight = 64; //segments sent but not yet acknowledged
+	constexpr uint32_t MaxEarly = 256; //how far ahead of the expected segment to keep out-of-order ones
+	constexpr double KeepAlive = 1.0; //seconds of sending nothing before sending an ack anyway
+	constexpr double Timeout = 10.0; //seconds of hearing nothing before giving up on the peer
+
+	double now_seconds() {
+		return std::chrono::duration< double >(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void put_u32(std::vector< uint8_t > &out, uint32_t v) {
+		for (uint32_t i = 0; i < 4; ++i) out.emplace_back(uint8_t(v >> (8 * i)));
+	}
+	uint32_t get_u32(uint8_t const *at) {
+		return uint32_t(at[0]) | (uint32_t(at[1]) << 8) | (uint32_t(at[2]) << 16) | (uint32_t(at[3]) << 24);
+	}
+	//size of a framed message (see Wire) at the start of 'data', or 0 if it isn't all there:
+	// (throws if the header is malformed)
+	size_t framed_size(uint8_t const *data, size_t size) {
+		Wire::Frame frame;
+		return Wire::peek(data, size, &frame) ? frame.total() : 0;
+	}
+	//same, for a message starting at byte 'at' of a queue:
+	size_t framed_size(ByteQueue const &queue, size_t at) {
+		Wire::Frame frame;
+		return Wire::peek(queue, at, &frame) ? frame.total() : 0;
+	}
+
+	void udp_send(Connection &c, uint8_t const *data, size_t size) {
+		if (c.socket == InvalidSocket) return;
+		//(a full socket buffer just drops the datagram, like the network would)
+		if (c.udp.owns_socket) {
+			send(c.socket, reinterpret_cast< char const * >(data), int(size), MSG_DONTWAIT);
+		} else {
+			sendto(c.socket, reinterpret_cast< char const * >(data), int(size), MSG_DONTWAIT, reinterpret_cast< sockaddr const * >(c.udp.peer.data()), socklen_t(c.udp.peer.size()));
+		}
+		c.udp.last_sent = now_seconds();
+	}
+	void udp_send_control(Connection &c, uint8_t kind) {
+		udp_send(c, &kind, 1);
+	}
+	void udp_send_ack(Connection &c) {
+		std::vector< uint8_t > ack{UdpAck};
+		put_u32(ack, c.udp.expected_segment);
+		udp_send(c, ack.data(), ack.size());
+		c.udp.ack_due = false;
+	}
+
+	//move send_buffer into the channels and send whatever is due:
+	void udp_flush(Connection &c, std::vector< uint8_t > const &latest_only) {
+		auto &udp = c.udp;
+		double now = now_seconds();
+
+		//split send_buffer into messages: latest-only ones replace each other, the rest join the reliable stream
+		std::vector< uint8_t > reliable;
+		size_t latest_at = 0, latest_size = 0;
+		size_t at = 0;
+		while (size_t size = framed_size(c.send_buffer, at)) {
+			if (std::find(latest_only.begin(), latest_only.end(), c.send_buffer[at]) != latest_only.end()) {
+				if (latest_size) c.backlog.replaced += 1;
+				latest_at = at;
+				latest_size = size;
+			} else {
+				reliable.resize(reliable.size() + size);
+				c.send_buffer.copy(at, size, reliable.data() + reliable.size() - size);
+			}
+			at += size;
+		}
+
+		if (latest_size) {
+			uint32_t sequence = udp.next_latest++;
+			size_t payload = MaxDatagram - LatestHeader;
+			uint32_t count = uint32_t((latest_size + payload - 1) / payload);
+			std::vector< uint8_t > datagram;
+			for (uint32_t i = 0; i < count; ++i) {
+				datagram.assign({UdpLatest});
+				put_u32(datagram, sequence);
+				datagram.insert(datagram.end(), {uint8_t(i), uint8_t(i >> 8), uint8_t(count), uint8_t(count >> 8)});
+				size_t begin = latest_at + i * payload;
+				size_t end = std::min(begin + payload, latest_at + latest_size);
+				datagram.resize(LatestHeader + (end - begin));
+				c.send_buffer.copy(begin, end - begin, datagram.data() + LatestHeader);
+				udp_send(c, datagram.data(), datagram.size());
+			}
+		}
+		c.send_buffer.consume(at);
+
+		for (size_t begin = 0; begin < reliable.size(); begin += MaxDatagram - SegmentHeader) {
+			size_t end = std::min(begin + MaxDatagram - SegmentHeader, reliable.size());
+			Connection::Datagrams::Segment segment;
+			segment.sequence = udp.next_segment++;
+			segment.data.assign(reliable.begin() + begin, reliable.begin() + end);
+			udp.unacked.emplace_back(std::move(segment));
+		}
+
+		//(re)send segments that were never sent or have waited too long for an ack:
+		std::vector< uint8_t > datagram;
+		for (size_t i = 0; i < udp.unacked.size() && i < MaxInFlight; ++i) {
+			auto &segment = udp.unacked[i];
+			if (segment.sent_at >= 0.0 && now - segment.sent_at < ResendAfter) continue;
+			datagram.assign({UdpSegment});
+			put_u32(datagram, segment.sequence);
+			datagram.insert(datagram.end(), segment.data.begin(), segment.data.end());
+			udp_send(c, datagram.data(), datagram.size());
+			segment.sent_at = now;
+		}
+
+		if (udp.ack_due || now - udp.last_sent > KeepAlive) {
+			udp_send_ack(c);
+		}
+	}
+
+	//handle one datagram from the connection's peer; returns true if recv_buffer grew:
+	bool udp_receive(Connection &c, uint8_t const *data, size_t size) {
+		auto &udp = c.udp;
+		if (size == 0) return false;
+		udp.last_heard = now_seconds();
+
+		if (data[0] == UdpSegment && size >= SegmentHeader) {
+			uint32_t sequence = get_u32(data + 1);
+			udp.ack_due = true;
+			int32_t ahead = int32_t(sequence - udp.expected_segment);
+			if (ahead < 0 || uint32_t(ahead) >= MaxEarly) return false; //old duplicate, or too far ahead to keep
+			udp.early[sequence].assign(data + SegmentHeader, data + size);
+			//deliver everything that is now in order:
+			for (auto next = udp.early.find(udp.expected_segment); next != udp.early.end(); next = udp.early.find(udp.expected_segment)) {
+				udp.stream.insert(udp.stream.end(), next->second.begin(), next->second.end());
+				udp.early.erase(next);
+				udp.expected_segment += 1;
+			}
+			//hand over whole messages only, so latest-only ones never land in the middle of one:
+			size_t at = 0;
+			while (size_t message = framed_size(udp.stream.data() + at, udp.stream.size() - at)) {
+				at += message;
+			}
+			if (at == 0) return false;
+			c.recv_buffer.append(udp.stream.data(), at);
+			udp.stream.erase(udp.stream.begin(), udp.stream.begin() + at);
+			return true;
+		} else if (data[0] == UdpAck && size >= 5) {
+			uint32_t next = get_u32(data + 1);
+			while (!udp.unacked.empty() && int32_t(next - udp.unacked.front().sequence) > 0) {
+				udp.unacked.pop_front();
+			}
+			return false;
+		} else if (data[0] == UdpLatest && size > LatestHeader) {
+			uint32_t sequence = get_u32(data + 1);
+			uint32_t index = uint32_t(data[5]) | (uint32_t(data[6]) << 8);
+			uint32_t count = uint32_t(data[7]) | (uint32_t(data[8]) << 8);
+			if (int32_t(sequence - udp.latest_delivered) <= 0) return false; //older than what was already delivered
+			if (sequence != udp.assembling) {
+				if (int32_t(sequence - udp.assembling) < 0) return false; //older than the one being put together
+				//a newer message replaces whatever was partly here:
+				udp.assembling = sequence;
+				udp.fragments.assign(count, std::vector< uint8_t >());
+				udp.fragments_missing = count;
+			}
+			if (index >= udp.fragments.size() || count != udp.fragments.size() || !udp.fragments[index].empty()) return false;
+			udp.fragments[index].assign(data + LatestHeader, data + size);
+			udp.fragments_missing -= 1;
+			if (udp.fragments_missing != 0) return false;
+
+			std::vector< uint8_t > message;
+			for (auto const &fragment : udp.fragments) {
+				message.insert(message.end(), fragment.begin(), fragment.end());
+			}
+			udp.fragments.clear();
+			udp.latest_delivered = sequence;
+			if (framed_size(message.data(), message.size()) != message.size()) return false; //not one whole message, drop it
+			c.recv_buffer.append(message.data(), message.size());
+			return true;
+		}
+		//(Hello, Welcome, and Bye are handled by the caller; anything else is ignored)
+		return false;
+	}
+
+	#ifdef _WIN32
+	//on windows, MSG_DONTWAIT doesn't exist, so make the socket itself non-blocking:
+	void set_nonblocking(Socket s) {
+		unsigned long one = 1;
+		ioctlsocket(s, FIONBIO, &one);
+	}
+	#else
+	void set_nonblocking(Socket) { }
+	#endif
+
+	//say hello over a connected datagram socket until the server welcomes us (or a few seconds pass):
+	bool udp_handshake(Socket s) {
+		set_nonblocking(s);
+		uint8_t hello = UdpHello;
+		for (uint32_t attempt = 0; attempt < 20; ++attempt) {
+			send(s, reinterpret_cast< char const * >(&hello), 1, MSG_DONTWAIT);
+			fd_set read_fds;
+			FD_ZERO(&read_fds);
+			FD_SET(s, &read_fds);
+			struct timeval tv;
+			tv.tv_sec = 0;
+			tv.tv_usec = 250000;
+			if (select(int(s) + 1, &read_fds, NULL, NULL, &tv) <= 0) continue;
+			uint8_t reply[MaxDatagram];
+			ssize_t ret = recv(s, reinterpret_cast< char * >(reply), sizeof(reply), MSG_DONTWAIT);
+			if (ret >= 1 && reply[0] == UdpWelcome) return true;
+		}
+		return false;
+	}
+}
+
 void Connection::close() {
 	if (socket != InvalidSocket) {
-		::closesocket(socket);
+		if (transport == Transport::UDP) {
+			udp_send_control(*this, UdpBye);
+			if (udp.owns_socket) ::closesocket(socket);
+		} else {
+			::closesocket(socket);
+		}
 		socket = InvalidSocket;
+		if (closed_list) closed_list->push_back(this);
+	}
+}
+
+//---------------------------------
+//Reading and writing helpers used by both TCP pollers:
+
+//read everything the socket has:
+static void recv_pending(char const *where, Connection &c, std::function< void(Connection *, Connection::Event event) > const &on_event) {
+	const uint32_t BufferSize = 20000;
+	static thread_local char *buffer = new char[BufferSize];
+
+	while (true) { //read until more data left to read
+		ssize_t ret = recv(c.socket, buffer, BufferSize, MSG_DONTWAIT);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//~no problem~ but no data
+			break;
+		} else if (ret <= 0 || ret > (ssize_t)BufferSize) {
+			//~problem~ so remove connection
+			if (ret == 0) {
+				std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
+			} else if (ret < 0) {
+				std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
+			} else {
+				std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting." << std::endl;
+			}
+			c.close();
+			if (on_event) on_event(&c, Connection::OnClose);
+			break;
+		} else { //ret > 0
+			c.recv_buffer.append(buffer, size_t(ret));
+			if (on_event) on_event(&c, Connection::OnRecv);
+			if (c.socket == InvalidSocket) break; //the handler closed the connection (e.g., on a malformed message)
+			if (ret < BufferSize) break; //ran out of data before buffer: no more data left to read
+		}
 	}
 }
 
+//send as much of send_buffer as the socket will take; returns false if it stopped taking data (or closed):
+// ('framed': send_buffer holds whole messages, so keep track of the one that is partly sent -- see limit_send_buffer)
+static bool send_pending(char const *where, Connection &c, std::function< void(Connection *, Connection::Event event) > const &on_event, bool framed) {
+	while (c.socket != InvalidSocket && !c.send_buffer.empty()) {
+		ByteQueue::View runs[2];
+		#ifdef _WIN32
+		//(just the first run; the loop comes back for the rest)
+		c.send_buffer.views(0, c.send_buffer.size(), runs);
+		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(runs[0].data), int(runs[0].size), MSG_DONTWAIT);
+		#else
+		//both runs of the ring in one call:
+		uint32_t count = c.send_buffer.views(0, c.send_buffer.size(), runs);
+		iovec iov[2];
+		for (uint32_t i = 0; i < count; ++i) {
+			iov[i].iov_base = const_cast< uint8_t * >(runs[i].data);
+			iov[i].iov_len = runs[i].size;
+		}
+		msghdr message;
+		std::memset(&message, 0, sizeof(message));
+		message.msg_iov = iov;
+		message.msg_iovlen = count;
+		ssize_t ret = sendmsg(c.socket, &message, MSG_DONTWAIT);
+		#endif 
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//~no problem~, but don't keep trying
+			return false;
+		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
+			if (ret < 0) {
+				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
+			} else { assert(ret == 0 || ret > (ssize_t)c.send_buffer.size());
+				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
+			}
+			c.close();
+			if (on_event) on_event(&c, Connection::OnClose);
+			return false;
+		} else { //ret seems reasonable
+			if (framed) {
+				//step over the messages that were (started to be) sent:
+				size_t at = c.send_sealed;
+				while (at < size_t(ret)) {
+					size_t size = framed_size(c.send_buffer, at);
+					if (size == 0) { at = size_t(ret); break; } //(not framed after all; nothing to protect)
+					at += size;
+				}
+				c.send_sealed = at - size_t(ret);
+				c.send_coalesced -= std::min(c.send_coalesced, size_t(ret));
+			}
+			c.send_buffer.consume(size_t(ret));
+		}
+	}
+	return c.socket != InvalidSocket;
+}
+
+//apply the Server/Client's limits to a connection's send_buffer before sending; returns false if it was closed:
+// - with TCP, a latest-only message that hasn't started to go out yet is dropped once a newer one of the same type
+//   is queued behind it (with UDP, udp_flush does the same);
+// - a connection with more than 'high_water' bytes still waiting to go out is closed (0: no limit).
+static bool limit_send_buffer(char const *where, Connection &c, std::vector< uint8_t > const &latest_only, size_t high_water, std::function< void(Connection *, Connection::Event event) > const &on_event) {
+	auto &queue = c.send_buffer;
+	if (c.transport == Transport::TCP && !latest_only.empty() && queue.size() != c.send_coalesced) {
+		//find the newest message of each latest-only type, past the partly-sent one:
+		std::vector< size_t > newest(latest_only.size(), queue.size());
+		uint32_t latest_count = 0;
+		size_t at = c.send_sealed;
+		while (size_t size = framed_size(queue, at)) {
+			auto f = std::find(latest_only.begin(), latest_only.end(), queue[at]);
+			if (f != latest_only.end()) {
+				newest[f - latest_only.begin()] = at;
+				latest_count += 1;
+			}
+			at += size;
+		}
+		uint32_t kept = uint32_t(std::count_if(newest.begin(), newest.end(), [&](size_t n){ return n != queue.size(); }));
+		if (latest_count > kept) {
+			//rebuild everything past the partly-sent message without the stale ones:
+			std::vector< uint8_t > rest;
+			rest.reserve(queue.size() - c.send_sealed);
+			at = c.send_sealed;
+			while (size_t size = framed_size(queue, at)) {
+				auto f = std::find(latest_only.begin(), latest_only.end(), queue[at]);
+				if (f == latest_only.end() || newest[f - latest_only.begin()] == at) {
+					rest.resize(rest.size() + size);
+					queue.copy(at, size, rest.data() + rest.size() - size);
+				}
+				at += size;
+			}
+			rest.resize(rest.size() + (queue.size() - at));
+			queue.copy(at, queue.size() - at, rest.data() + rest.size() - (queue.size() - at));
+			queue.truncate(c.send_sealed);
+			queue.append(rest.data(), rest.size());
+			c.backlog.replaced += latest_count - kept;
+		}
+		c.send_coalesced = queue.size();
+	}
+
+	c.backlog.peak = std::max(c.backlog.peak, queue.size());
+	if (high_water != 0 && queue.size() > high_water) {
+		std::cerr << "[" << where << "] " << queue.size() << " bytes waiting to send (more than the high water mark of " << high_water << "), disconnecting." << std::endl;
+		c.close();
+		if (on_event) on_event(&c, Connection::OnClose);
+		return false;
+	}
+	return true;
+}
+
 //---------------------------------
-//Polling helper used by both server and client:
+//Polling helper used by both server and client (Poller::Select):
 void poll_connections(
 	char const *where,
 	std::list< Connection > &connections,
 	std::function< void(Connection *, Connection::Event event) > const &on_event,
 	double timeout,
+	std::vector< uint8_t > const &latest_only,
+	size_t high_water,
 	Socket listen_socket = InvalidSocket) {
 
+	for (auto &c : connections) {
+		if (c.socket != InvalidSocket) limit_send_buffer(where, c, latest_only, high_water, on_event);
+	}
+
 	fd_set read_fds, write_fds;
 	FD_ZERO(&read_fds);
 	FD_ZERO(&write_fds);
@@ -74,7 +457,7 @@ void poll_connections(
 	}
 
 	//add each connection's socket to read (and possibly write) sets:
-	for (auto c : connections) {
+	for (auto const &c : connections) {
 		if (c.socket != InvalidSocket) {
 			max = std::max(max, int(c.socket));
 			FD_SET(c.socket, &read_fds);
@@ -104,6 +487,12 @@ void poll_connections(
 		Socket got = accept(listen_socket, NULL, NULL);
 		if (got == InvalidSocket) {
 			//oh well.
+		#ifndef _WIN32
+		} else if (got >= FD_SETSIZE) {
+			//(windows fd_sets are lists, not bitmasks, so only elsewhere is this a hard limit)
+			std::cerr << "[" << where << "] socket " << got << " is past FD_SETSIZE, which select() can't watch; refusing connection (Poller::Epoll doesn't have this limit)." << std::endl;
+			::closesocket(got);
+		#endif
 		} else {
 			#ifdef _WIN32
 			unsigned long one = 1;
@@ -119,72 +508,243 @@ void poll_connections(
 		}
 	}
 
-	const uint32_t BufferSize = 20000;
-	static thread_local char *buffer = new char[BufferSize];
-
 	//process requests:
 	for (auto &c : connections) {
 		//only read from valid sockets marked readable:
 		if (c.socket == InvalidSocket || !FD_ISSET(c.socket, &read_fds)) continue;
+		recv_pending(where, c, on_event);
+	}
 
-		while (true) { //read until more data left to read
-			ssize_t ret = recv(c.socket, buffer, BufferSize, MSG_DONTWAIT);
-			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-				//~no problem~ but no data
-				break;
-			} else if (ret <= 0 || ret > (ssize_t)BufferSize) {
-				//~problem~ so remove connection
-				if (ret == 0) {
-					std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
-				} else if (ret < 0) {
-					std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
-				} else {
-					std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting." << std::endl;
+	//process responses:
+	for (auto &c : connections) {
+		//don't bother with connections unless they are valid, have something to send, and are marked writable:
+		if (c.socket == InvalidSocket || c.send_buffer.empty() || !FD_ISSET(c.socket, &write_fds)) continue;
+		send_pending(where, c, on_event, !latest_only.empty());
+	}
+}
+
+#ifdef __linux__
+//---------------------------------
+//Polling helper used by both server and client (Poller::Epoll):
+// every socket stays registered with 'epoll_fd' (edge-triggered, data.ptr = its Connection, nullptr for the listen socket),
+// so waiting costs nothing per idle connection and there is no FD_SETSIZE limit.
+// Only connections with events get sent to; see flush_epoll for data queued elsewhere.
+void poll_epoll(
+	char const *where,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	std::vector< uint8_t > const &latest_only,
+	size_t high_water,
+	int epoll_fd,
+	Socket listen_socket = InvalidSocket) {
+
+	constexpr int MaxEvents = 256;
+	epoll_event events[MaxEvents];
+	int count = epoll_wait(epoll_fd, events, MaxEvents, int(std::ceil(std::max(0.0, timeout) * 1000.0)));
+	if (count < 0) {
+		if (errno != EINTR) {
+			std::cerr << "[" << where << "] epoll_wait() returned error " << errno << "(" << strerror(errno) << ")." << std::endl;
+		}
+		return;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		if (events[i].data.ptr == nullptr) {
+			//add new connections (all of them, the listen socket won't say so again):
+			while (true) {
+				Socket got = accept4(listen_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (got == InvalidSocket) break; //(EAGAIN: no more waiting; anything else: oh well.)
+				connections.emplace_back();
+				Connection &c = connections.back();
+				c.socket = got;
+				epoll_event event;
+				event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+				event.data.ptr = &c;
+				if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, got, &event) != 0) {
+					std::cerr << "[" << where << "] couldn't watch socket " << got << ": " << strerror(errno) << "; refusing connection." << std::endl;
+					c.close();
+					continue;
 				}
-				c.close();
-				if (on_event) on_event(&c, Connection::OnClose);
-				break;
-			} else { //ret > 0
-				c.recv_buffer.insert(c.recv_buffer.end(), buffer, buffer + ret);
-				if (on_event) on_event(&c, Connection::OnRecv);
-				if (ret < BufferSize) break; //ran out of data before buffer: no more data left to read
+				std::cerr << "[" << where << "] client connected on " << c.socket << "." << std::endl; //INFO
+				if (on_event) on_event(&c, Connection::OnOpen);
 			}
+			continue;
+		}
+
+		//(connections only leave the list after poll returns, so the pointer is good; the socket may have closed since)
+		Connection &c = *reinterpret_cast< Connection * >(events[i].data.ptr);
+		if (c.socket == InvalidSocket) continue;
+		if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+			recv_pending(where, c, on_event);
 		}
+		//send on a writable event, or whatever the handlers just queued (edge-triggered: a socket that last took everything won't report writable again):
+		if (c.socket == InvalidSocket || !((events[i].events & EPOLLOUT) || (c.write_ready && !c.send_buffer.empty()))) continue;
+		if (!limit_send_buffer(where, c, latest_only, high_water, on_event)) continue;
+		c.write_ready = send_pending(where, c, on_event, !latest_only.empty());
 	}
+}
+
+//Sending helper for Poller::Epoll: send to every connection that has something queued and a socket that is ready for it
+// (O(connections), so run it once per batch of sends rather than on every poll):
+void flush_epoll(
+	char const *where,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	std::vector< uint8_t > const &latest_only,
+	size_t high_water) {
 
-	//process responses:
 	for (auto &c : connections) {
-		//don't bother with connections unless they are valid, have something to send, and are marked writable:
-		if (c.socket == InvalidSocket || c.send_buffer.empty() || !FD_ISSET(c.socket, &write_fds)) continue;
-		
-		#ifdef _WIN32
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), int(c.send_buffer.size()), MSG_DONTWAIT);
-		#else
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(), MSG_DONTWAIT);
-		#endif 
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			//~no problem~, but don't keep trying
-			break;
-		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
-			if (ret < 0) {
-				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
-			} else { assert(ret == 0 || ret > (ssize_t)c.send_buffer.size());
-				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
+		if (c.socket == InvalidSocket || !limit_send_buffer(where, c, latest_only, high_water, on_event)) continue;
+		if (c.write_ready && !c.send_buffer.empty()) {
+			c.write_ready = send_pending(where, c, on_event, !latest_only.empty());
+		}
+	}
+}
+
+//create an epoll instance watching 'socket' (edge-triggered, tagged with 'connection'); returns -1 on failure:
+static int epoll_watch(Socket socket, Connection *connection) {
+	int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) return -1;
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLET | (connection ? (EPOLLOUT | EPOLLRDHUP) : 0);
+	event.data.ptr = connection;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket, &event) != 0) {
+		::close(epoll_fd);
+		return -1;
+	}
+	return epoll_fd;
+}
+#endif
+
+//---------------------------------
+//Polling helper for UDP connections, used by both server and client:
+// with a server, 'shared_socket' is the one socket all connections share, and new peers that say hello become connections
+void poll_datagrams(
+	char const *where,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	std::vector< uint8_t > const &latest_only,
+	size_t high_water,
+	Socket shared_socket = InvalidSocket) {
+
+	//send what was queued since the last poll before waiting:
+	for (auto &c : connections) {
+		if (c.socket != InvalidSocket && limit_send_buffer(where, c, latest_only, high_water, on_event)) udp_flush(c, latest_only);
+	}
+
+	fd_set read_fds;
+	FD_ZERO(&read_fds);
+	int max = 0;
+	if (shared_socket != InvalidSocket) {
+		max = std::max(max, int(shared_socket));
+		FD_SET(shared_socket, &read_fds);
+	}
+	for (auto const &c : connections) {
+		if (c.socket != InvalidSocket && c.udp.owns_socket) {
+			max = std::max(max, int(c.socket));
+			FD_SET(c.socket, &read_fds);
+		}
+	}
+
+	{ //wait (until timeout) for datagrams to arrive:
+		struct timeval tv;
+		tv.tv_sec = std::lround(std::floor(timeout));
+		tv.tv_usec = std::lround((timeout - std::floor(timeout)) * 1e6);
+		int ret = select(max + 1, &read_fds, NULL, NULL, &tv);
+		if (ret < 0) {
+			std::cerr << "[" << where << "] Select returned an error; will attempt to read anyway." << std::endl;
+		}
+	}
+
+	const uint32_t BufferSize = 65536;
+	static thread_local uint8_t *buffer = new uint8_t[BufferSize];
+
+	//peers closing or going quiet, without saying goodbye back:
+	auto drop = [&](Connection &c, char const *why) {
+		std::cerr << "[" << where << "] " << why << ", disconnecting." << std::endl;
+		if (c.udp.owns_socket) ::closesocket(c.socket);
+		c.socket = InvalidSocket;
+		if (c.closed_list) c.closed_list->push_back(&c);
+		if (on_event) on_event(&c, Connection::OnClose);
+	};
+	auto handle = [&](Connection &c, uint8_t const *data, size_t size) {
+		if (data[0] == UdpBye) {
+			drop(c, "peer said goodbye");
+		} else if (data[0] == UdpHello) {
+			//our welcome got lost:
+			c.udp.last_heard = now_seconds();
+			udp_send_control(c, UdpWelcome);
+		} else {
+			bool received;
+			try {
+				received = udp_receive(c, data, size);
+			} catch (std::exception const &e) {
+				std::cerr << "[" << where << "] " << e.what() << std::endl;
+				drop(c, "malformed stream");
+				return;
+			}
+			if (received && on_event) on_event(&c, Connection::OnRecv);
+		}
+	};
+
+	if (shared_socket != InvalidSocket && FD_ISSET(shared_socket, &read_fds)) {
+		while (true) {
+			sockaddr_storage from;
+			socklen_t from_size = sizeof(from);
+			ssize_t ret = recvfrom(shared_socket, reinterpret_cast< char * >(buffer), BufferSize, MSG_DONTWAIT, reinterpret_cast< sockaddr * >(&from), &from_size);
+			if (ret <= 0) break; //nothing left (or an error about some earlier datagram, which doesn't matter)
+			uint8_t const *from_bytes = reinterpret_cast< uint8_t const * >(&from);
+
+			Connection *found = nullptr;
+			for (auto &c : connections) {
+				if (c.socket != InvalidSocket && c.udp.peer.size() == size_t(from_size) && std::equal(c.udp.peer.begin(), c.udp.peer.end(), from_bytes)) {
+					found = &c;
+					break;
+				}
+			}
+			if (found) {
+				handle(*found, buffer, size_t(ret));
+			} else if (buffer[0] == UdpHello) {
+				connections.emplace_back();
+				Connection &c = connections.back();
+				c.socket = shared_socket;
+				c.transport = Transport::UDP;
+				c.udp.peer.assign(from_bytes, from_bytes + from_size);
+				c.udp.owns_socket = false;
+				c.udp.last_heard = now_seconds();
+				udp_send_control(c, UdpWelcome);
+				std::cerr << "[" << where << "] client connected over UDP." << std::endl; //INFO
+				if (on_event) on_event(&c, Connection::OnOpen);
 			}
-			c.close();
-			if (on_event) on_event(&c, Connection::OnClose);
-		} else { //ret seems reasonable
-			c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
+		}
+	}
+	for (auto &c : connections) {
+		if (c.socket == InvalidSocket || !c.udp.owns_socket || !FD_ISSET(c.socket, &read_fds)) continue;
+		while (c.socket != InvalidSocket) {
+			ssize_t ret = recv(c.socket, reinterpret_cast< char * >(buffer), BufferSize, MSG_DONTWAIT);
+			if (ret <= 0) break; //nothing left (or e.g. ECONNREFUSED from an earlier send; the timeout handles peers that are really gone)
+			handle(c, buffer, size_t(ret));
 		}
 	}
 
-		
+	//time out quiet peers, and send acks and anything the event handlers queued:
+	double now = now_seconds();
+	for (auto &c : connections) {
+		if (c.socket == InvalidSocket) continue;
+		if (now - c.udp.last_heard > Timeout) {
+			drop(c, "timed out");
+			continue;
+		}
+		udp_flush(c, latest_only);
+	}
 }
 
 //---------------------------------
 
 
-Server::Server(std::string const &port) {
+Server::Server(std::string const &port, Transport transport_, Poller poller_) : transport(transport_), poller(poller_) {
 
 	#ifdef _WIN32
 	{ //init winsock:
@@ -199,7 +759,7 @@ Server::Server(std::string const &port) {
 		struct addrinfo hints;
 		memset(&hints, 0, sizeof(hints));
 		hints.ai_family = AF_UNSPEC;
-		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_socktype = (transport == Transport::UDP ? SOCK_DGRAM : SOCK_STREAM);
 		hints.ai_flags = AI_PASSIVE;
 
 		struct addrinfo *res = nullptr;
@@ -265,29 +825,77 @@ Server::Server(std::string const &port) {
 		throw std::runtime_error("Failed to bind to port " + port);
 	}
 
+	if (transport == Transport::UDP) {
+		//no listening with datagrams; peers just say hello (see poll_datagrams):
+		set_nonblocking(listen_socket);
+		return;
+	}
+
 	{ //listen on socket
-		int ret = ::listen(listen_socket, 5);
+		int ret = ::listen(listen_socket, SOMAXCONN);
 		if (ret < 0) {
 			closesocket(listen_socket);
 			throw std::system_error(errno, std::system_category(), "failed to listen on socket");
 		}
 	}
+
+	if (poller == Poller::Epoll) {
+		#ifdef __linux__
+		//the accept loop in poll_epoll needs accept() to stop at EAGAIN:
+		fcntl(listen_socket, F_SETFL, fcntl(listen_socket, F_GETFL, 0) | O_NONBLOCK);
+		epoll_fd = epoll_watch(listen_socket, nullptr);
+		#endif
+		if (epoll_fd < 0) {
+			std::cout << "[Server::Server] epoll isn't available; using select() instead." << std::endl;
+			poller = Poller::Select;
+		}
+	}
+}
+
+Server::~Server() {
+	#ifdef __linux__
+	if (epoll_fd >= 0) ::close(epoll_fd);
+	#endif
 }
 
 void Server::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+	//(new connections go on the end of the list)
+	auto last = (connections.empty() ? connections.end() : std::prev(connections.end()));
+
+	if (transport == Transport::UDP) {
+		poll_datagrams("Server::poll", connections, on_event, timeout, latest_only, high_water, listen_socket);
+	#ifdef __linux__
+	} else if (poller == Poller::Epoll) {
+		poll_epoll("Server::poll", connections, on_event, timeout, latest_only, high_water, epoll_fd, listen_socket);
+	#endif
+	} else {
+		poll_connections("Server::poll", connections, on_event, timeout, latest_only, high_water, listen_socket);
+	}
+
+	//have new connections report closing (the ones already closed, e.g. by an OnOpen handler, report now):
+	for (auto c = (last == connections.end() ? connections.begin() : std::next(last)); c != connections.end(); ++c) {
+		c->position = c;
+		c->closed_list = &closed;
+		if (c->socket == InvalidSocket) closed.emplace_back(&*c);
+	}
 
 	//reap closed clients:
-	for (auto connection = connections.begin(); connection != connections.end(); /*later*/) {
-		auto old = connection;
-		++connection;
-		if (old->socket == InvalidSocket) {
-			connections.erase(old);
-		}
+	for (Connection *c : closed) {
+		connections.erase(c->position);
 	}
+	closed.clear();
 }
 
-Client::Client(std::string const &host, std::string const &port) : connections(1), connection(connections.front()) {
+void Server::flush(std::function< void(Connection *, Connection::Event event) > const &on_event) {
+	#ifdef __linux__
+	if (transport == Transport::TCP && poller == Poller::Epoll) {
+		flush_epoll("Server::flush", connections, on_event, latest_only, high_water);
+	}
+	#endif
+}
+
+Client::Client(std::string const &host, std::string const &port, Transport transport, Poller poller_) : connections(1), connection(connections.front()), poller(poller_) {
+	connection.transport = transport;
 	#ifdef _WIN32
 	{ //init winsock:
 		WSADATA info;
@@ -301,8 +909,8 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 		struct addrinfo hints;
 		memset(&hints, 0, sizeof(hints));
 		hints.ai_family = AF_UNSPEC;
-		hints.ai_socktype = SOCK_STREAM;
-		hints.ai_protocol = IPPROTO_TCP;
+		hints.ai_socktype = (transport == Transport::UDP ? SOCK_DGRAM : SOCK_STREAM);
+		hints.ai_protocol = (transport == Transport::UDP ? IPPROTO_UDP : IPPROTO_TCP);
 
 		struct addrinfo *res = nullptr;
 		int addrinfo_ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
@@ -340,9 +948,15 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 				std::cout << "(failed to connect: " << strerror(errno) << ")" << std::endl;
 				continue;
 			}
+			if (transport == Transport::UDP && !udp_handshake(s)) {
+				std::cout << "(no answer to hello)" << std::endl;
+				::closesocket(s);
+				continue;
+			}
 			std::cout << "success!" << std::endl;
 
 			connection.socket = s;
+			connection.udp.last_heard = now_seconds();
 			break;
 		}
 
@@ -352,10 +966,33 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 			throw std::runtime_error("Failed to connect to any of the addresses tried for server.");
 		}
 	}
+
+	if (transport == Transport::TCP && poller == Poller::Epoll) {
+		#ifdef __linux__
+		epoll_fd = epoll_watch(connection.socket, &connection);
+		#endif
+		if (epoll_fd < 0) poller = Poller::Select;
+	}
 }
 
 
+Client::~Client() {
+	#ifdef __linux__
+	if (epoll_fd >= 0) ::close(epoll_fd);
+	#endif
+}
+
 void Client::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Client::poll", connections, on_event, timeout, InvalidSocket);
+	if (connection.transport == Transport::UDP) {
+		poll_datagrams("Client::poll", connections, on_event, timeout, latest_only, high_water);
+	#ifdef __linux__
+	} else if (poller == Poller::Epoll) {
+		//(only one connection, so it's as cheap to flush here as anywhere)
+		flush_epoll("Client::poll", connections, on_event, latest_only, high_water);
+		poll_epoll("Client::poll", connections, on_event, timeout, latest_only, high_water, epoll_fd);
+	#endif
+	} else {
+		poll_connections("Client::poll", connections, on_event, timeout, latest_only, high_water, InvalidSocket);
+	}
 }
 
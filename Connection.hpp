@@ -1,7 +1,8 @@
 #pragma once
 
 /* 
- * Connection is a simple wrapper around a TCP socket connection.
+ * Connection is a simple wrapper around a TCP socket connection
+ * (or, with Transport::UDP, a connection made of datagrams).
  * You don't create 'Connection' objects yourself, rather, you
  * create a Client or Server object which will manage connection(s)
  * for you.
@@ -14,7 +15,8 @@ int main(int argc, char **argv) {
 		server.poll([](Connection *connection, Connection::Event evt){
 			if (evt == Connection::OnRecv) {
 				//extract and erase data from the connection's recv_buffer:
-				std::vector< uint8_t > data = connection->recv_buffer;
+				std::vector< uint8_t > data(connection->recv_buffer.size());
+				connection->recv_buffer.copy(0, data.size(), data.data());
 				connection->recv_buffer.clear();
 				//send to other connections:
 
@@ -22,6 +24,7 @@ int main(int argc, char **argv) {
 		},
 		1.0 //timeout (in seconds)
 		);
+		server.flush(); //send anything queued outside of poll()'s callback
 	}
 }
 
@@ -60,13 +63,51 @@ int main(int argc, char **argv) {
 #endif
 //--------- ---------------------------------- ---------
 
+#include "ByteQueue.hpp"
+
 #include <vector>
 #include <list>
+#include <deque>
+#include <map>
 #include <string>
 #include <functional>
 #include <cstdint>
 
-//Thin wrapper around a (polling-based) TCP socket connection:
+//How a Server/Client moves bytes:
+// TCP: send_buffer and recv_buffer are the two ends of one ordered byte stream.
+// UDP: datagrams, for links where one lost packet shouldn't stall everything behind it.
+//   This needs everything in send_buffer framed as [type, size varint, data...] (see Wire.hpp),
+//   as all of Game's messages are. Messages whose type is listed in the Server/Client's 'latest_only'
+//   are sent unreliably, and only the newest one queued since the last poll() goes out (fragmented to
+//   fit the MTU); everything else goes over a reliable, ordered channel. recv_buffer still only ever
+//   holds whole messages, in the order they arrived.
+//With either transport, a non-empty 'latest_only' means send_buffer must hold whole framed messages:
+// over TCP, a latest-only message that hasn't started to go out is dropped once a newer one of its type
+// is queued behind it, so a slow reader gets the newest one next instead of falling further behind.
+enum class Transport : uint8_t {
+	TCP,
+	UDP,
+};
+
+//How Server/Client::poll waits on TCP sockets:
+// Select: builds fd_sets on every call, so each wakeup costs O(connections), and sockets must be below FD_SETSIZE.
+// Epoll: (Linux only) sockets stay registered (edge-triggered), so a wakeup only costs as much as the sockets that are ready.
+//   Falls back to Select where epoll isn't available.
+// (UDP connections share one socket, so they always use select.)
+enum class Poller : uint8_t {
+	Select,
+	Epoll,
+};
+#ifdef __linux__
+constexpr Poller DefaultPoller = Poller::Epoll;
+#else
+constexpr Poller DefaultPoller = Poller::Select;
+#endif
+
+//Server/Client::high_water starts here:
+constexpr size_t DefaultHighWater = size_t(4) << 20;
+
+//Thin wrapper around a (polling-based) TCP socket connection, or a UDP one (see Transport):
 struct Connection {
 	//Helper that will append any type to the send buffer:
 	template< typename T >
@@ -75,7 +116,7 @@ struct Connection {
 	}
 	//Helper that will append raw bytes to the send buffer:
 	void send_raw(void const *data, size_t size) {
-		send_buffer.insert(send_buffer.end(), reinterpret_cast< uint8_t const * >(data), reinterpret_cast< uint8_t const * >(data) + size);
+		send_buffer.append(data, size);
 	}
 
 	//Call 'close' to mark a connection for discard:
@@ -85,22 +126,67 @@ struct Connection {
 	explicit operator bool() { return socket != InvalidSocket; }
 
 	//To send data over a connection, append it to send_buffer:
-	std::vector< uint8_t > send_buffer;
-	//When the connection receives data, it is appended to recv_buffer:
-	std::vector< uint8_t > recv_buffer;
+	ByteQueue send_buffer;
+	//When the connection receives data, it is appended to recv_buffer (parsers 'consume' it from the front):
+	ByteQueue recv_buffer;
 
 	//internals:
 	Socket socket = InvalidSocket;
+	Transport transport = Transport::TCP;
+	bool write_ready = false; //Poller::Epoll: the socket took everything last time, so no new writable event will come
+	size_t send_sealed = 0; //TCP with latest_only: bytes at the front of send_buffer finishing a message that is partly sent
+	size_t send_coalesced = 0; //TCP with latest_only: send_buffer.size() when stale messages were last dropped
+	std::vector< Connection * > *closed_list = nullptr; //a Server's connections: close() reports here, so Server::poll only reaps what closed
+	std::list< Connection >::iterator position; //a Server's connections: where this one is in Server::connections
+
+	//how far behind sending has been (reset these whenever you like):
+	struct Backlog {
+		size_t peak = 0; //most bytes seen waiting in send_buffer
+		uint32_t replaced = 0; //latest-only messages dropped unsent because a newer one was queued
+	} backlog;
 
 	enum Event {
 		OnOpen,
 		OnRecv,
 		OnClose
 	};
+
+	//UDP state (see Transport):
+	struct Datagrams {
+		std::vector< uint8_t > peer; //address of the other end (a sockaddr), for sendto()
+		bool owns_socket = true; //false for a server's connections, which share its socket
+
+		//reliable channel, sending: segments wait in 'unacked' until the peer acknowledges them
+		struct Segment {
+			uint32_t sequence = 0;
+			std::vector< uint8_t > data;
+			double sent_at = -1.0; //-1: not sent yet
+		};
+		std::deque< Segment > unacked;
+		uint32_t next_segment = 0;
+		//reliable channel, receiving:
+		uint32_t expected_segment = 0; //next segment to deliver
+		std::map< uint32_t, std::vector< uint8_t > > early; //segments that arrived ahead of 'expected_segment'
+		std::vector< uint8_t > stream; //delivered bytes that don't make a whole message yet
+		bool ack_due = false;
+
+		//latest-only messages:
+		uint32_t next_latest = 1; //sending
+		uint32_t latest_delivered = 0; //receiving: newest message handed to recv_buffer
+		uint32_t assembling = 0; //receiving: message whose fragments are arriving
+		std::vector< std::vector< uint8_t > > fragments;
+		uint32_t fragments_missing = 0;
+
+		double last_heard = 0.0; //for timeouts
+		double last_sent = 0.0; //for keepalives
+	} udp;
 };
 
 struct Server {
-	Server(std::string const &port); //pass the port number to listen on, as a string (servname, really)
+	Server(std::string const &port, Transport transport = Transport::TCP, Poller poller = DefaultPoller); //pass the port number to listen on, as a string (servname, really)
+	~Server();
+	Server(Server const &) = delete;
+	Server &operator=(Server const &) = delete;
 
 	//poll() updates the list of active connections and sends/receives data if possible:
 	// (will wait up to 'timeout' for first event)
@@ -109,13 +195,29 @@ struct Server {
 		double timeout = 0.0 //timeout (seconds)
 	);
 
+	//flush() sends what was queued outside of poll()'s callbacks (call it once after queueing, e.g. each tick):
+	// with Poller::Epoll, poll() only sends to connections that have events, so without this such data waits
+	// until the connection next hears something. (The other pollers send everything in poll(), so this does nothing.)
+	void flush(
+		std::function< void(Connection *, Connection::Event event) > const &connection_event = nullptr
+	);
+
 	std::list< Connection > connections;
-	Socket listen_socket = InvalidSocket;
+	std::vector< Connection * > closed; //connections closed since the last poll(), which will reap them
+	Socket listen_socket = InvalidSocket; //with UDP, the one socket every connection shares
+	Transport transport;
+	Poller poller;
+	int epoll_fd = -1; //Poller::Epoll only
+	std::vector< uint8_t > latest_only; //message types where only the newest unsent one matters (see Transport)
+	size_t high_water = DefaultHighWater; //close connections with more than this many bytes waiting to send (0: never)
 };
 
 
 struct Client {
-	Client(std::string const &host, std::string const &port);
+	Client(std::string const &host, std::string const &port, Transport transport = Transport::TCP, Poller poller = DefaultPoller);
+	~Client();
+	Client(Client const &) = delete;
+	Client &operator=(Client const &) = delete;
 
 	//poll() checks the status of the active connection and sends/receives data if possible:
 	// (will wait up to 'timeout' for first event)
@@ -126,4 +228,8 @@ struct Client {
 
 	std::list< Connection > connections; //will only ever contain exactly one connection
 	Connection &connection; //reference to the only connection in the connections list
+	Poller poller;
+	int epoll_fd = -1; //Poller::Epoll only
+	std::vector< uint8_t > latest_only; //message types where only the newest unsent one matters (see Transport)
+	size_t high_water = DefaultHighWater; //close connections with more than this many bytes waiting to send (0: never)
 };
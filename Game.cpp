@@ -1,11 +1,14 @@
 #include "Game.hpp"
 
 #include "Connection.hpp"
+#include "Wire.hpp"
 #include "PlayMode.hpp"
 
 #include <stdexcept>
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <iterator>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/norm.hpp>
@@ -19,35 +22,66 @@ Game::Game()
 
 Game::~Game()
 {
-    for (auto obj : game_objects)
-    {
-        free(obj);
-    }
 }
 
 void Game::init_player_spawn_info(Player *player)
 {
-    player->data.spawn_pos = SpawnPos[next_player_number];
-    player->position = SpawnPos[next_player_number];
+    // wrap around so a long-running match can keep taking new players:
+    glm::vec2 spawn = SpawnPos[next_player_number % std::size(SpawnPos)];
+    player->data.spawn_pos = spawn;
+    player->position = spawn;
     next_player_number++;
 }
 
+size_t Game::memory_usage() const
+{
+    return sizeof(Game) + players.memory_usage() + torpedoes.memory_usage() + flags.memory_usage() + dynamic_bvh.memory_usage() + (tick_objects.capacity() + tick_deferred.capacity()) * sizeof(NetworkObject *) + level.revealed_objects.capacity() * sizeof(Level::RevealedObject);
+}
+
 void Game::remove_object(uint32_t id)
 {
     bool found = false;
-    for (auto pi = game_objects.begin(); pi != game_objects.end(); ++pi)
+    auto remove_from = [&](auto &pool)
     {
-        if ((*pi)->id == id)
+        for (auto obj : pool.live)
         {
-            game_objects.erase(pi);
-            free(*pi);
-            found = true;
-            break;
+            if (obj->id == id)
+            {
+                dynamic_bvh.remove(obj->proxy);
+                pool.recycle(obj);
+                found = true;
+                return;
+            }
         }
-    }
+    };
+    remove_from(players);
+    if (!found)
+        remove_from(torpedoes);
+    if (!found)
+        remove_from(flags);
     assert(found);
 }
 
+void Game::remove_deleted_objects()
+{
+    auto sweep = [&](auto &pool)
+    {
+        // walk backwards so the swap-with-last in recycle() never skips an object:
+        for (size_t i = pool.live.size(); i > 0; --i)
+        {
+            auto obj = pool.live[i - 1];
+            if (obj->deleted)
+            {
+                dynamic_bvh.remove(obj->proxy);
+                pool.recycle(obj);
+            }
+        }
+    };
+    sweep(players);
+    sweep(torpedoes);
+    sweep(flags);
+}
+
 void Game::update(float elapsed)
 {
     // spawn flag
@@ -76,55 +110,578 @@ void Game::update(float elapsed)
         }
     }
 
-    for (NetworkObject *obj : game_objects)
+    // pick up objects that were placed after spawn_object() or moved since the last update:
+    tick_objects.clear();
+    for_each_object([&](NetworkObject *obj)
+                    {
+        refit_object(obj);
+        obj->next_position = obj->position;
+        tick_objects.push_back(obj); });
+
+    // phase one, objects only read the rest of the world:
+    if (profile)
+        tick_object_ms.assign(tick_objects.size(), 0.0);
+    auto update_object = [&](size_t i)
     {
-        obj->update(elapsed, this);
+        if (!profile)
+        {
+            tick_objects[i]->update(elapsed, this);
+            return;
+        }
+        auto before = std::chrono::steady_clock::now();
+        tick_objects[i]->update(elapsed, this);
+        tick_object_ms[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - before).count();
+    };
+    if (workers)
+        workers->parallel_for(tick_objects.size(), update_object);
+    else
+        for (size_t i = 0; i < tick_objects.size(); ++i)
+            update_object(i);
+
+    if (profile)
+    {
+        update_ms.fill(0.0);
+        for (size_t i = 0; i < tick_objects.size(); ++i)
+            update_ms[size_t(tick_objects[i]->type)] += tick_object_ms[i];
     }
+
+    // phase two, apply the results in an order that doesn't depend on scheduling:
+    tick_deferred.clear();
+    for (NetworkObject *obj : tick_objects)
+    {
+        obj->position = obj->next_position;
+        if (!obj->deferred.empty())
+            tick_deferred.push_back(obj);
+    }
+    std::stable_sort(tick_deferred.begin(), tick_deferred.end(), [](NetworkObject const *a, NetworkObject const *b)
+                     { return a->id < b->id; });
+    for (NetworkObject *obj : tick_deferred)
+    {
+        for (auto &call : obj->deferred)
+            call(this);
+        obj->deferred.clear();
+    }
+
+    for_each_object([&](NetworkObject *obj)
+                    { refit_object(obj); });
     level.update(elapsed);
 }
 
-void Game::send_state_message(Connection *connection_, Player *connection_player) const
+void Game::refit_object(NetworkObject *obj)
+{
+    dynamic_bvh.update(obj->proxy, obj);
+}
+
+void Game::gather_interest(Player const *viewer, std::vector<uint32_t> &out) const
+{
+    out.clear();
+    out.emplace_back(viewer->id);
+
+    // everything the viewer's radar could reach, plus a margin so objects are already there as they come in range:
+    float range = viewer->data.normal_radar_range + InterestMargin;
+    glm::vec2 center = viewer->position;
+    BBox area = {center - glm::vec2(range), center + glm::vec2(range)};
+    dynamic_bvh.query(area, [&](GameObject *obj)
+                      {
+        // distance from the center to the closest point of the object's box:
+        BBox box = obj->get_BBox();
+        glm::vec2 closest = glm::clamp(center, box.min, box.max);
+        if (glm::length2(closest - center) <= range * range)
+            out.emplace_back(static_cast<NetworkObject *>(obj)->id); });
+
+    // and anything a super radar revealed:
+    for (auto const &ro : level.revealed_objects)
+        out.emplace_back(ro.obj_id);
+
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+void Game::capture_frame()
+{
+    frame.objects.clear();
+    frame.players.clear();
+    for_each_object([&](NetworkObject const *obj)
+                    {
+        // snapped to the wire grid here, so comparing snapshots is the same as comparing what would be sent:
+        Snapshot::Object o;
+        o.id = obj->id;
+        o.type = obj->type;
+        o.position = glm::vec2(NetworkObject::PositionX.round_trip(obj->position.x), NetworkObject::PositionY.round_trip(obj->position.y));
+        o.velocity = glm::vec2(NetworkObject::VelocityAxis.round_trip(obj->velocity.x), NetworkObject::VelocityAxis.round_trip(obj->velocity.y));
+        o.scale = glm::vec2(NetworkObject::ScaleAxis.round_trip(obj->scale.x), NetworkObject::ScaleAxis.round_trip(obj->scale.y));
+        o.deleted = obj->deleted;
+        frame.objects.emplace_back(o);
+        if (obj->type == ObjectType::Player)
+            frame.players.emplace_back(obj->id, static_cast<Player const *>(obj)->data); });
+    std::sort(frame.objects.begin(), frame.objects.end(), [](Snapshot::Object const &a, Snapshot::Object const &b)
+              { return a.id < b.id; });
+    std::sort(frame.players.begin(), frame.players.end(), [](auto const &a, auto const &b)
+              { return a.first < b.first; });
+
+    // sound cues, lined up with frame.objects:
+    frame_sound_cues.assign(frame.objects.size(), 0);
+    for_each_object([&](NetworkObject const *obj)
+                    {
+        if (obj->sound_cues == 0)
+            return;
+        Snapshot::Object const *o = frame.find(obj->id);
+        frame_sound_cues[o - frame.objects.data()] = obj->sound_cues; });
+
+    // subs and flags, which every client gets at least every FarRefreshTicks:
+    frame_always.clear();
+    for (uint32_t i = 0; i < frame.objects.size(); ++i)
+        if (frame.objects[i].type != ObjectType::Torpedo)
+            frame_always.emplace_back(i);
+
+    frame.revealed_objects.clear();
+    for (auto const &ro : level.revealed_objects)
+        frame.revealed_objects.emplace_back(ro.obj_id);
+}
+
+void Game::capture_snapshot(Snapshot &out, std::vector<uint8_t> &sound_cues, Player const *viewer, Snapshot const *baseline) const
+{
+    out.revealed_objects = frame.revealed_objects;
+    if (!viewer)
+    {
+        out.objects = frame.objects;
+        out.players = frame.players;
+        sound_cues = frame_sound_cues;
+        return;
+    }
+
+    // the frame entries this client gets: its interest set, merged with the subs and flags
+    // (both lists are sorted by id, since frame.objects is):
+    gather_interest(viewer, interest_ids);
+    interest_slots.clear();
+    for (uint32_t id : interest_ids)
+        if (Snapshot::Object const *o = frame.find(id))
+            interest_slots.emplace_back(uint32_t(o - frame.objects.data()));
+    snapshot_slots.clear();
+    std::set_union(interest_slots.begin(), interest_slots.end(), frame_always.begin(), frame_always.end(), std::back_inserter(snapshot_slots));
+
+    out.objects.clear();
+    out.players.clear();
+    sound_cues.clear();
+    for (uint32_t slot : snapshot_slots)
+    {
+        Snapshot::Object const &obj = frame.objects[slot];
+        Player::PlayerData const *data = frame.find_player(obj.id);
+        if (!std::binary_search(interest_slots.begin(), interest_slots.end(), slot))
+        {
+            // out of range: only refreshed every FarRefreshTicks (staggered by id), so the super radar has
+            // something to point at; in between, resend what the client already has, which costs nothing in the diff.
+            // (the baseline is whatever the client last acked, so refresh if a refresh tick passed since it, not just on one)
+            Snapshot::Object const *known = baseline ? baseline->find(obj.id) : nullptr;
+            if (known && !known->deleted && (out.sequence + obj.id) / FarRefreshTicks == (baseline->sequence + obj.id) / FarRefreshTicks)
+            {
+                out.objects.emplace_back(*known);
+                sound_cues.emplace_back(0);
+                if (Player::PlayerData const *known_data = baseline->find_player(obj.id))
+                    out.players.emplace_back(obj.id, *known_data);
+                continue;
+            }
+        }
+        out.objects.emplace_back(obj);
+        sound_cues.emplace_back(frame_sound_cues[slot]);
+        if (data)
+            out.players.emplace_back(obj.id, *data);
+    }
+}
+
+// a list of ids, sorted increasing, as a count and then the gaps between them:
+static void send_ids(BitWriter &writer, std::vector<uint32_t> const &ids)
+{
+    writer.write_varbits(uint32_t(ids.size()));
+    uint32_t previous_id = 0;
+    for (uint32_t id : ids)
+    {
+        writer.write_varbits(id - previous_id);
+        previous_id = id;
+    }
+}
+
+static void receive_ids(BitReader &reader, std::vector<uint32_t> &ids)
+{
+    ids.clear();
+    uint32_t count = reader.read_varbits();
+    uint32_t previous_id = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        previous_id += reader.read_varbits();
+        ids.emplace_back(previous_id);
+    }
+}
+
+void Game::send_state_message(Connection *connection_, Player *connection_player, SnapshotHistory &history) const
 {
     assert(connection_);
     auto &connection = *connection_;
 
-    connection.send(Message::S2C_State);
-    // will patch message size in later, for now placeholder bytes:
-    connection.send(uint8_t(0));
-    connection.send(uint8_t(0));
-    connection.send(uint8_t(0));
-    size_t mark = connection.send_buffer.size(); // keep track of this position in the buffer
+    uint32_t sequence = history.next_sequence++;
+    // diff against the newest snapshot the client has, as long as it is still in the ring
+    // (checked before capturing, since the capture may reuse its slot):
+    Snapshot const *baseline = history.find(history.acked);
+    if (baseline && sequence - baseline->sequence >= SnapshotHistory::Size)
+        baseline = nullptr;
+    const Snapshot empty;
+    if (!baseline)
+        baseline = &empty;
+
+    Snapshot &current = history.slot(sequence);
+    current.sequence = sequence;
+    capture_snapshot(current, snapshot_sound_cues, connection_player, baseline);
 
-    // send game objects
-    connection.send(uint8_t(game_objects.size()));
+    // the body is bit-packed; ids go out in increasing order within each list, as the gap from the previous one.
+    // (it's built on the side, since the header needs its size)
+    message_body.clear();
+    BitWriter writer(message_body);
+    writer.write(sequence, 32);
+    writer.write(baseline->sequence, 32);
+    writer.write_varbits(connection_player ? connection_player->id : 0);
+    // (so the client knows which of its inputs this state already includes)
+    current.input_sequence = connection_player ? connection_player->controls.sequence : 0;
+    writer.write_varbits(current.input_sequence);
 
-    // send local players
-    if (connection_player)
-        connection_player->send(&connection);
+    // send objects that are new or changed since the baseline:
+    const Snapshot::Object blank;
+    snapshot_changes.clear();
+    for (size_t i = 0; i < current.objects.size(); ++i)
+    {
+        Snapshot::Object const &obj = current.objects[i];
+        Snapshot::Object const *base = baseline->find(obj.id);
+        uint8_t mask = obj.changed_fields(base ? *base : blank);
+        if (mask == 0)
+            continue;
+        snapshot_changes.emplace_back(uint32_t(i), mask);
+    }
+    writer.write_varbits(uint32_t(snapshot_changes.size()));
+    uint32_t previous_id = 0;
+    for (auto const &[i, mask] : snapshot_changes)
+    {
+        Snapshot::Object const &obj = current.objects[i];
+        writer.write_varbits(obj.id - previous_id);
+        previous_id = obj.id;
+        obj.send(writer, mask);
+    }
 
-    // send game objects
-    for (auto const &obj : game_objects)
+    // send objects that are gone:
+    snapshot_ids.clear();
+    for (auto const &obj : baseline->objects)
     {
-        if (obj == connection_player)
+        if (obj.deleted || current.find(obj.id))
             continue;
+        snapshot_ids.emplace_back(obj.id);
+    }
+    send_ids(writer, snapshot_ids);
 
-        obj->send(&connection);
+    // send player data that changed, then players that left:
+    snapshot_ids.clear();
+    for (auto const &[id, data] : current.players)
+    {
+        Player::PlayerData const *base = baseline->find_player(id);
+        if (base && base->synced_equals(data))
+            continue;
+        snapshot_ids.emplace_back(id);
     }
-    // send player data
-    auto players = get_objects<Player>();
-    connection.send(uint8_t(players.size()));
-    for (auto p : players)
+    writer.write_varbits(uint32_t(snapshot_ids.size()));
+    previous_id = 0;
+    for (uint32_t id : snapshot_ids)
     {
-        connection.send(uint32_t(p->id));
-        p->data.send(&connection);
+        writer.write_varbits(id - previous_id);
+        previous_id = id;
+        current.find_player(id)->send(writer);
     }
 
-    // send level data
-    level.send(&connection);
+    snapshot_ids.clear();
+    for (auto const &[id, data] : baseline->players)
+    {
+        if (current.find_player(id))
+            continue;
+        snapshot_ids.emplace_back(id);
+    }
+    send_ids(writer, snapshot_ids);
+
+    // send level data if it changed:
+    bool level_changed = (current.revealed_objects != baseline->revealed_objects);
+    writer.write(level_changed);
+    if (level_changed)
+        level.send(writer);
+    writer.flush();
+
+    Wire::send(connection.send_buffer, uint8_t(Message::S2C_State), message_body);
+
+    // sound cues are one-shot, so they go in their own message, which transports deliver reliably
+    // (a state message may be dropped in favor of a newer one):
+    snapshot_ids.clear();
+    for (size_t i = 0; i < current.objects.size(); ++i)
+        if (snapshot_sound_cues[i] != 0)
+            snapshot_ids.emplace_back(uint32_t(i));
+    if (snapshot_ids.empty())
+        return;
+
+    message_body.clear();
+    BitWriter events(message_body);
+    events.write_varbits(uint32_t(snapshot_ids.size()));
+    previous_id = 0;
+    for (uint32_t i : snapshot_ids)
+    {
+        Snapshot::Object const &obj = current.objects[i];
+        events.write_varbits(obj.id - previous_id);
+        previous_id = obj.id;
+        events.write(uint32_t(obj.type), 2);
+        events.write(NetworkObject::PositionX, NetworkObject::PositionY, obj.position);
+        events.write(snapshot_sound_cues[i], 8);
+    }
+    events.flush();
+
+    Wire::send(connection.send_buffer, uint8_t(Message::S2C_Events), message_body);
+}
+
+static void send_version_message(Connection *connection, Message type)
+{
+    ByteQueue body;
+    Wire::write_varint(body, ProtocolVersion);
+    Wire::send(connection->send_buffer, uint8_t(type), body);
+}
+
+// reads a hello or welcome; returns the version it carries, or 0 if the message isn't all here yet:
+static uint32_t recv_version_message(Connection *connection, Message type, char const *what)
+{
+    auto &recv_buffer = connection->recv_buffer;
+    Wire::Frame frame;
+    if (!Wire::peek(recv_buffer, 0, &frame))
+        return 0;
+    if (frame.type != uint8_t(type))
+        throw std::runtime_error(std::string("Expected a ") + what + " message, got type " + std::to_string(frame.type) + ".");
+    size_t at = frame.header;
+    uint32_t version = Wire::read_varint(recv_buffer, at, frame.total());
+    if (at != frame.total())
+        throw std::runtime_error(std::string("Trailing data in ") + what + " message.");
+    if (version != ProtocolVersion)
+        throw std::runtime_error("Peer speaks protocol version " + std::to_string(version) + ", but this build speaks version " + std::to_string(ProtocolVersion) + ".");
+    recv_buffer.consume(frame.total());
+    return version;
+}
+
+void Game::send_hello_message(Connection *connection)
+{
+    assert(connection);
+    send_version_message(connection, Message::C2S_Hello);
+}
+
+bool Game::recv_hello_message(Connection *connection)
+{
+    assert(connection);
+    return recv_version_message(connection, Message::C2S_Hello, "hello") != 0;
+}
+
+void Game::send_welcome_message(Connection *connection)
+{
+    assert(connection);
+    send_version_message(connection, Message::S2C_Welcome);
+}
+
+bool Game::recv_welcome_message(Connection *connection)
+{
+    assert(connection);
+    // (anything else before the welcome is left for the other parsers to complain about)
+    Wire::Frame frame;
+    if (!Wire::peek(connection->recv_buffer, 0, &frame) || frame.type != uint8_t(Message::S2C_Welcome))
+        return false;
+    return recv_version_message(connection, Message::S2C_Welcome, "welcome") != 0;
+}
+
+bool Game::recv_events_message(Connection *connection_, std::function<void(NetworkObject &)> const &on_cue)
+{
+    assert(connection_);
+    auto &connection = *connection_;
+    auto &recv_buffer = connection.recv_buffer;
+
+    // expecting a complete [type, size, body] message (see Wire):
+    Wire::Frame frame;
+    if (!Wire::peek(recv_buffer, 0, &frame) || frame.type != uint8_t(Message::S2C_Events))
+        return false;
+
+    BitReader reader(recv_buffer.contiguous(frame.header, frame.size), frame.size);
+    std::vector<NetworkObject> cues;
+    uint32_t count = reader.read_varbits();
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        NetworkObject &obj = cues.emplace_back();
+        id += reader.read_varbits();
+        obj.id = id;
+        obj.type = ObjectType(reader.read(2));
+        obj.position = reader.read(NetworkObject::PositionX, NetworkObject::PositionY);
+        obj.sound_cues = uint8_t(reader.read(8));
+    }
+    if (!reader.at_end())
+        throw std::runtime_error("Trailing data in events message.");
+
+    // delete message from buffer:
+    recv_buffer.consume(frame.total());
+
+    for (auto &obj : cues)
+        on_cue(obj);
+    return true;
+}
+
+bool Game::recv_state_message(Connection *connection_,
+                              std::function<void(NetworkObject &)> const &on_object,
+                              std::function<void(uint32_t, Player::PlayerData &)> const &on_player_data,
+                              Level &level,
+                              SnapshotHistory &history)
+{
+    assert(connection_);
+    auto &connection = *connection_;
+    auto &recv_buffer = connection.recv_buffer;
+
+    // expecting a complete [type, size, body] message (see Wire):
+    Wire::Frame frame;
+    if (!Wire::peek(recv_buffer, 0, &frame) || frame.type != uint8_t(Message::S2C_State))
+        return false;
+
+    // the body is bit-packed (see send_state_message); the reader throws rather than run past it:
+    BitReader reader(recv_buffer.contiguous(frame.header, frame.size), frame.size);
+
+    uint32_t sequence = reader.read(32);
+    uint32_t baseline_sequence = reader.read(32);
+    uint32_t local_id = reader.read_varbits();
+    uint32_t input_sequence = reader.read_varbits();
+    const Snapshot empty;
+    Snapshot const *baseline = &empty;
+    if (baseline_sequence != 0)
+    {
+        baseline = history.find(baseline_sequence);
+        if (!baseline)
+            throw std::runtime_error("State message is a diff against unknown snapshot " + std::to_string(baseline_sequence) + ".");
+    }
+    // (a diff must be newer than its baseline, and close enough that they don't share a slot in the ring;
+    //  full snapshots, which the server falls back to when acks get old, can have any sequence)
+    bool diff_in_range = (baseline_sequence == 0 || (sequence != baseline_sequence && sequence - baseline_sequence < SnapshotHistory::Size));
+    if (sequence == 0 || !diff_in_range)
+        throw std::runtime_error("State message has bad sequence " + std::to_string(sequence) + ".");
+
+    // rebuild the world: start from the baseline, minus what was already deleted in it...
+    Snapshot &current = history.slot(sequence);
+    current.sequence = sequence;
+    current.input_sequence = input_sequence;
+    current.objects.clear();
+    for (auto const &obj : baseline->objects)
+        if (!obj.deleted)
+            current.objects.emplace_back(obj);
+
+    // ...apply changed and new objects...
+    const Snapshot::Object blank;
+    uint32_t changed_count = reader.read_varbits();
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < changed_count; ++i)
+    {
+        id += reader.read_varbits();
+        Snapshot::Object const *base = baseline->find(id);
+        Snapshot::Object obj = Snapshot::Object::receive(reader, base ? *base : blank);
+        obj.id = id;
+        auto it = std::lower_bound(current.objects.begin(), current.objects.end(), id, [](Snapshot::Object const &o, uint32_t id)
+                                   { return o.id < id; });
+        if (it != current.objects.end() && it->id == id)
+            *it = obj;
+        else
+            current.objects.insert(it, obj);
+    }
+
+    // ...and drop removed ones:
+    std::vector<uint32_t> removed;
+    receive_ids(reader, removed);
+    for (uint32_t id : removed)
+    {
+        Snapshot::Object const *o = current.find(id);
+        if (o)
+            current.objects.erase(current.objects.begin() + (o - current.objects.data()));
+    }
+
+    // same for players:
+    current.players = baseline->players;
+    uint32_t player_data_count = reader.read_varbits();
+    uint32_t player_id = 0;
+    for (uint32_t i = 0; i < player_data_count; ++i)
+    {
+        player_id += reader.read_varbits();
+        Player::PlayerData data;
+        data.receive(reader);
+        auto it = std::lower_bound(current.players.begin(), current.players.end(), player_id, [](auto const &p, uint32_t id)
+                                   { return p.first < id; });
+        if (it != current.players.end() && it->first == player_id)
+            it->second = data;
+        else
+            current.players.emplace(it, player_id, data);
+    }
+    std::vector<uint32_t> players_left;
+    receive_ids(reader, players_left);
+    for (uint32_t player_id : players_left)
+    {
+        current.players.erase(std::remove_if(current.players.begin(), current.players.end(), [&](auto const &p)
+                                             { return p.first == player_id; }),
+                              current.players.end());
+    }
+
+    // receive level data
+    bool level_changed = reader.read_bool();
+    if (level_changed)
+    {
+        level.receive(reader);
+        current.revealed_objects.clear();
+        for (auto const &ro : level.revealed_objects)
+            current.revealed_objects.emplace_back(ro.obj_id);
+    }
+    else
+    {
+        current.revealed_objects = baseline->revealed_objects;
+        level.revealed_objects.clear();
+        for (uint32_t id : current.revealed_objects)
+            level.revealed_objects.push_back(Level::RevealedObject{id, 0.0f, 0.0f});
+    }
+
+    if (!reader.at_end())
+    {
+        throw std::runtime_error("Trailing data in state message.");
+    }
+
+    // hand the rebuilt world out, the connection's own player first:
+    auto emit = [&](Snapshot::Object const &o)
+    {
+        NetworkObject obj;
+        obj.id = o.id;
+        obj.type = o.type;
+        obj.position = o.position;
+        obj.velocity = o.velocity;
+        obj.scale = o.scale;
+        obj.deleted = o.deleted;
+        on_object(obj);
+    };
+    Snapshot::Object const *local = current.find(local_id);
+    if (local)
+        emit(*local);
+    for (auto const &o : current.objects)
+        if (&o != local)
+            emit(o);
+    // objects that went away without the client seeing them deleted:
+    for (uint32_t id : removed)
+    {
+        Snapshot::Object gone;
+        gone.id = id;
+        gone.deleted = true;
+        emit(gone);
+    }
+    for (auto &[id, data] : current.players)
+        on_player_data(id, data);
+
+    // delete message from buffer:
+    recv_buffer.consume(frame.total());
+
+    // let the server diff against this one from now on:
+    SnapshotHistory::send_ack_message(&connection, sequence);
+    history.latest = sequence;
 
-    // compute the message size and patch into the message header:
-    uint32_t size = uint32_t(connection.send_buffer.size() - mark);
-    connection.send_buffer[mark - 3] = uint8_t(size);
-    connection.send_buffer[mark - 2] = uint8_t(size >> 8);
-    connection.send_buffer[mark - 1] = uint8_t(size >> 16);
+    return true;
 }
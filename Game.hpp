@@ -5,10 +5,17 @@
 #include "Raycast.hpp"
 #include "Sound.hpp"
 #include "Level.hpp"
+#include "ObjectPool.hpp"
+#include "Snapshot.hpp"
+#include "WorkerPool.hpp"
 
 #include <glm/glm.hpp>
+#include <array>
+#include <chrono>
+#include <functional>
 #include <string>
 #include <list>
+#include <memory>
 #include <random>
 #include <vector>
 
@@ -20,11 +27,18 @@ struct Connection;
 
 enum class Message : uint8_t
 {
-    C2S_Controls = 1, // Greg!
+    C2S_Hello = 'h', // first message on every connection: [protocol version: varint]
+    S2C_Welcome = 'w', // reply to a hello the server accepted: [protocol version: varint]
+    C2S_Controls = 1, // Greg! (a batch of inputs, see InputSender)
+    C2S_Ack = 'a',
     S2C_State = 's',
+    S2C_Events = 'e', // sound cues that went with a state message
     //...
 };
 
+// bump whenever any message changes; clients and servers only talk if theirs match (see Game::send_hello_message):
+constexpr uint32_t ProtocolVersion = 4;
+
 enum class SoundCues : uint8_t
 {
     Start = 1 << 0,
@@ -37,54 +51,130 @@ enum class SoundCues : uint8_t
 struct Game
 {
     std::mt19937 mt{0x15466666}; // used for spawning players
-    std::uniform_int_distribution<uint32_t> dist{1u, 0xFFFFFFFFu};
+    // ids are handed out in order so state messages can send them as small gaps (0 is never an object):
+    uint32_t next_object_id = 1;
 
     uint32_t next_player_number = 1; // used for naming players
 
-    std::list<GameObject> static_obstacles;  // the collision box should not be sync, instead generated from the scene on both server and client (if the client needs it)
-    std::list<NetworkObject *> game_objects; // the dynamic game object sync to from server to client
-    BVH bvh;
+    // the dynamic game object sync to from server to client, one pool per type:
+    ObjectPool<Player, NetworkObject> players;
+    ObjectPool<Torpedo, NetworkObject> torpedoes;
+    ObjectPool<Flag, NetworkObject> flags;
+    // static obstacles; the collision box should not be sync, instead generated from the scene on both server and client (if the client needs it)
+    // read only once built, so every match in a server process can share one
+    std::shared_ptr<BVH> bvh = std::make_shared<BVH>();
+    DynamicBVH dynamic_bvh; // all live network objects, refit as they move
 
     Level level;
 
     float flag_spawn_timer = 0;
+
+    // runs the per-object phase of update() across threads; nullptr runs it on the calling thread
+    // (both give exactly the same results)
+    WorkerPool *workers = nullptr;
+    // scratch lists for update(), kept to reuse their storage:
+    std::vector<NetworkObject *> tick_objects;
+    std::vector<NetworkObject *> tick_deferred;
+    std::vector<double> tick_object_ms;
+
+    // when set, update() times every object's update() and sums the times per type into update_ms:
+    bool profile = false;
+    std::array<double, 4> update_ms{}; // milliseconds, indexed by ObjectType, for the last update()
+
+    template <typename O>
+    ObjectPool<O, NetworkObject> &get_pool()
+    {
+        static_assert(std::is_base_of_v<NetworkObject, O>, "Can only pool network game object");
+        if constexpr (std::is_same_v<O, Player>)
+            return players;
+        else if constexpr (std::is_same_v<O, Torpedo>)
+            return torpedoes;
+        else
+            return flags;
+    }
+
+    template <typename O>
+    ObjectPool<O, NetworkObject> const &get_pool() const
+    {
+        return const_cast<Game *>(this)->get_pool<O>();
+    }
+
     template <typename O>
     O *spawn_object()
     {
         static_assert(std::is_base_of_v<NetworkObject, O>, "Can only spawn network game object");
-        O *obj = new O();
-        // NetworkObject *no = static_cast<NetworkObject *>(obj);
-        game_objects.push_back(obj);
-        obj->id = dist(mt);
+        O *obj = get_pool<O>().spawn();
+        obj->id = next_object_id++;
         obj->init();
+        obj->proxy = dynamic_bvh.insert(obj);
         return obj;
     }
 
+    // all live objects of type O, as a view into the pool (no allocation):
     template <typename O>
-    std::vector<O *> get_objects() const
+    ObjectSpan<O, NetworkObject> get_objects() const
     {
         static_assert(std::is_base_of_v<NetworkObject, O>, "Can only get network game object");
-        std::vector<O *> ret;
-        ret.clear();
-        for (auto obj : game_objects)
+        return get_pool<O>().objects();
+    }
+
+    // all live objects of the given type (empty for ObjectType::Obstacle):
+    std::span<NetworkObject *const> get_objects(ObjectType type) const
+    {
+        switch (type)
         {
-            O *no = dynamic_cast<O *>(obj);
-            if (no)
-            {
-                ret.push_back(no);
-            }
+        case ObjectType::Player:
+            return players.live;
+        case ObjectType::Torpedo:
+            return torpedoes.live;
+        case ObjectType::Flag:
+            return flags.live;
+        default:
+            return {};
         }
-        return ret;
     }
+
+    /**
+     * Calls f(NetworkObject *) on every live object.
+     * Objects spawned by f are visited in the same pass.
+     */
+    template <typename F>
+    void for_each_object(F &&f) const
+    {
+        for (ObjectType type : {ObjectType::Player, ObjectType::Torpedo, ObjectType::Flag})
+        {
+            // index (rather than iterate) since f may spawn into this pool:
+            for (size_t i = 0; i < get_objects(type).size(); ++i)
+                f(get_objects(type)[i]);
+        }
+    }
+
+    size_t object_count() const
+    {
+        return players.size() + torpedoes.size() + flags.size();
+    }
+
     /**
      * Don't call this to remove object, instead mark the object as deleted
      */
     void remove_object(uint32_t id);
+    // return every object marked deleted to its pool, called at the end of each tick:
+    void remove_deleted_objects();
     Game();
     ~Game();
-    // state update function:
+    /**
+     * State update function, in two phases:
+     *  1) every object's update() runs (in parallel if 'workers' is set) against the world as it
+     *     was at the start of the tick, writing only its own state and next_position;
+     *  2) positions are committed, then the damage/spawns/deletions each object deferred are
+     *     applied on this thread in id order.
+     */
     void update(float elapsed);
+    // call after moving an object outside of its own update():
+    void refit_object(NetworkObject *obj);
     void init_player_spawn_info(Player *player);
+    // rough count of the heap bytes this match holds (pools, trees, scratch lists), not counting the shared bvh
+    size_t memory_usage() const;
 
     // constants:
     // the update rate on the server:
@@ -105,8 +195,61 @@ struct Game
     inline static constexpr float PlayerSpeed = 2.0f;
     inline static constexpr float PlayerAccelHalflife = 0.25f;
 
+    // interest management constants:
+    inline static constexpr float InterestMargin = 2.0f;  // beyond the radar range
+    inline static constexpr uint32_t FarRefreshTicks = 15; // snapshots between updates of subs and flags out of range
+
     // used by server:
-    // send game state.
-    //   Will move "connection_player" to the front of the front of the sent list.
-    void send_state_message(Connection *connection, Player *connection_player = nullptr) const;
+    // send game state, as a diff against the newest snapshot in 'history' the client acknowledged.
+    //   The message names "connection_player" so the client can find its own sub, and only carries
+    //   what that player is interested in (see capture_snapshot).
+    //   Sound cues on those objects follow in an S2C_Events message.
+    void send_state_message(Connection *connection, Player *connection_player, SnapshotHistory &history) const;
+    // once per tick, after update() and before any send_state_message(): capture the synced state of the
+    //   whole world into 'frame' (sorted by id, values snapped to what the wire can carry);
+    //   every connection's snapshot is then cut from it instead of walking the world again
+    void capture_frame();
+    Snapshot frame;
+    std::vector<uint8_t> frame_sound_cues; // cue bits of frame.objects[i]
+    std::vector<uint32_t> frame_always;    // indices into frame.objects of the subs and flags
+    // the part of 'frame' that 'viewer' should see; sound_cues[i] is the cue bits of out.objects[i].
+    //   With no viewer, that is everything. Otherwise objects outside gather_interest() are left out (torpedoes),
+    //   or (subs and flags) copied from 'baseline' between refreshes every FarRefreshTicks snapshots.
+    //   out.sequence must already be set.
+    void capture_snapshot(Snapshot &out, std::vector<uint8_t> &sound_cues, Player const *viewer = nullptr, Snapshot const *baseline = nullptr) const;
+    // sorted ids of the objects 'viewer' is interested in: itself, anything in its radar range, and anything revealed
+    void gather_interest(Player const *viewer, std::vector<uint32_t> &out) const;
+    // scratch for send_state_message:
+    mutable std::vector<uint32_t> interest_ids;
+    mutable std::vector<uint32_t> interest_slots, snapshot_slots; // indices into frame.objects
+    mutable std::vector<uint8_t> snapshot_sound_cues;
+    mutable std::vector<std::pair<uint32_t, uint8_t>> snapshot_changes; // (index in the snapshot, DeltaField mask)
+    mutable std::vector<uint32_t> snapshot_ids;
+    mutable ByteQueue message_body; // message bodies are built here, then framed (see Wire)
+
+    // the handshake that opens every connection: the client says hello with its ProtocolVersion,
+    //   and the server welcomes it once it knows they speak the same protocol.
+    static void send_hello_message(Connection *connection);
+    // (server) returns 'false' if the hello isn't all here yet; throws if the first message isn't a hello for ProtocolVersion
+    static bool recv_hello_message(Connection *connection);
+    static void send_welcome_message(Connection *connection);
+    // (client) returns 'false' if there is no complete welcome message; throws if the server speaks another version
+    static bool recv_welcome_message(Connection *connection);
+
+    // used by clients (PlayMode and the load generator):
+    // parse one state message from the connection's recv_buffer, rebuild the world from it and
+    // the earlier snapshots in 'history', acknowledge it, and then call
+    //   on_object(NetworkObject &) for every object, the connection's own player first
+    //     (objects that went away are passed once more with 'deleted' set), then
+    //   on_player_data(uint32_t id, Player::PlayerData &) for every player,
+    // and read the level data into 'level'.
+    //  (returns 'false' if there is no complete state message, throws on a malformed one)
+    static bool recv_state_message(Connection *connection,
+                                   std::function<void(NetworkObject &)> const &on_object,
+                                   std::function<void(uint32_t, Player::PlayerData &)> const &on_player_data,
+                                   Level &level,
+                                   SnapshotHistory &history);
+    // parse one events message, calling on_cue(NetworkObject &) with the id, type, position and sound_cues of each cue
+    //  (returns 'false' if there is no complete events message, throws on a malformed one)
+    static bool recv_events_message(Connection *connection, std::function<void(NetworkObject &)> const &on_cue);
 };
@@ -21,19 +21,19 @@ inline float penetration1D(float min1, float max1, float min2, float max2)
     return (penl < penr) ? -penl : penr;
 }
 
-static inline void check_collision_in_axis(NetworkObject *object, float move, int axis, std::vector<GameObject *> candidates, std::vector<GameObject *> &hits)
+static inline void check_collision_in_axis(NetworkObject *object, glm::vec2 &pos, float move, int axis, std::vector<GameObject *> const &candidates, std::vector<GameObject *> &hits)
 {
     if (move == 0.0f)
         return;
 
     if (axis == 0)
-        object->position.x += move;
+        pos.x += move;
     else
-        object->position.y += move;
+        pos.y += move;
 
     for (int iter = 0; iter < 8; ++iter)
     {
-        BBox self = object->get_BBox();
+        BBox self{pos - object->scale, pos + object->scale};
         bool pushed = false;
 
         for (GameObject *o : candidates)
@@ -52,7 +52,7 @@ static inline void check_collision_in_axis(NetworkObject *object, float move, in
                     auto no = dynamic_cast<NetworkObject *>(o);
                     if (no == nullptr || object->can_collide(no) == 1)
                     {
-                        object->position.x += push;
+                        pos.x += push;
                         pushed = true;
                     }
                     hits.push_back(o);
@@ -70,7 +70,7 @@ static inline void check_collision_in_axis(NetworkObject *object, float move, in
                     auto no = dynamic_cast<NetworkObject *>(o);
                     if (no == nullptr || object->can_collide(no) == 1)
                     {
-                        object->position.y += push;
+                        pos.y += push;
                         pushed = true;
                     }
                     hits.push_back(o);
@@ -90,26 +90,73 @@ int NetworkObject::can_collide(const NetworkObject *other) const
 }
 
 void NetworkObject::gather_collision_candidates(Game *game, const BBox &sweepBox, std::vector<GameObject *> &out)
+{
+    gather_collision_candidates(*game->bvh, game->dynamic_bvh, sweepBox, out);
+}
+
+void NetworkObject::gather_collision_candidates(BVH &statics, DynamicBVH const &dynamics, const BBox &sweepBox, std::vector<GameObject *> &out)
 {
     out.clear();
     out.reserve(64);
-    for (auto &s : game->static_obstacles)
-    {
-        if (s.get_BBox().overlaps(sweepBox))
-            out.push_back(&s);
-    }
-    for (auto *o : game->game_objects)
-    {
+    statics.query(sweepBox, out);
+    dynamics.query(sweepBox, [&](GameObject *g)
+                            {
+        auto o = static_cast<NetworkObject *>(g);
+        if (!can_collide_with(o->type))
+            return;
         if (can_collide(o) > 0)
         {
             if (o->get_BBox().overlaps(sweepBox))
                 out.push_back(o);
-        }
-    }
+        } });
+}
+
+Trace NetworkObject::sweep(Game *game, glm::vec2 movement) const
+{
+    return sweep(*game->bvh, game->dynamic_bvh, movement);
+}
+
+Trace NetworkObject::sweep(BVH const &statics, DynamicBVH const &dynamics, glm::vec2 movement) const
+{
+    float length = glm::length(movement);
+    if (length < 1e-6f)
+        return Trace();
+
+    Ray2D ray(position, movement, glm::vec2(0.0f, length));
+    Trace closest = statics.sweep(ray, scale);
+    Trace h = dynamics.sweep(ray, scale, [&](const GameObject *g)
+                                      {
+        auto o = static_cast<const NetworkObject *>(g);
+        return o != this && can_collide_with(o->type) && can_collide(o) > 0; });
+    if (h.hit && h.distance < closest.distance)
+        closest = h;
+    return closest;
 }
 
-std::vector<GameObject *> NetworkObject::move_with_collision(Game *game, glm::vec2 movement)
+std::vector<GameObject *> NetworkObject::move_with_collision(Game *game, glm::vec2 movement, Trace *contact)
 {
+    return move_with_collision(*game->bvh, game->dynamic_bvh, movement, contact);
+}
+
+std::vector<GameObject *> NetworkObject::move_with_collision(BVH &statics, DynamicBVH const &dynamics, glm::vec2 movement, Trace *contact)
+{
+    if (continuous_collision)
+    {
+        Trace trace = sweep(statics, dynamics, movement);
+        if (contact)
+            *contact = trace;
+        if (!trace.hit)
+        {
+            next_position = position + movement;
+            return {};
+        }
+        // stop just short of the contact point so the next sweep doesn't start inside it:
+        float length = glm::length(movement);
+        next_position = position + movement * (std::max(0.0f, trace.distance - ContactSkin) / length);
+        // the hit object is owned by game, which we have mutable access to:
+        return {const_cast<GameObject *>(trace.obj)};
+    }
+
     BBox box = get_BBox();
     BBox sweep;
     sweep.min = glm::min(box.min, box.min + movement);
@@ -117,14 +164,19 @@ std::vector<GameObject *> NetworkObject::move_with_collision(Game *game, glm::ve
 
     std::vector<GameObject *> candidates;
 
-    gather_collision_candidates(game, sweep, candidates);
+    gather_collision_candidates(statics, dynamics, sweep, candidates);
     std::vector<GameObject *> hits;
-    check_collision_in_axis(this, movement.x, 0, candidates, hits);
-    check_collision_in_axis(this, movement.y, 1, candidates, hits);
-
-    std::sort(hits.begin(), hits.end());
-    hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
-    return hits;
+    next_position = position;
+    check_collision_in_axis(this, next_position, movement.x, 0, candidates, hits);
+    check_collision_in_axis(this, next_position, movement.y, 1, candidates, hits);
+
+    // drop repeats but keep the order things were hit in, so which collider wins doesn't depend on addresses:
+    std::vector<GameObject *> unique_hits;
+    unique_hits.reserve(hits.size());
+    for (GameObject *h : hits)
+        if (std::find(unique_hits.begin(), unique_hits.end(), h) == unique_hits.end())
+            unique_hits.push_back(h);
+    return unique_hits;
     // float movement_length = glm::length(movement);
     // glm::vec2 movement_direction = glm::normalize(movement);
     // Ray2D collision_detection_ray(position, movement_direction);
@@ -178,38 +230,3 @@ Trace GameObject::hit(Ray2D ray) const
 void NetworkObject::init()
 {
 }
-
-void NetworkObject::send(Connection *connection) const
-{
-    connection->send(id);
-    connection->send(type);
-    connection->send(position);
-    connection->send(velocity);
-    connection->send(scale);
-    connection->send(deleted);
-    connection->send(sound_cues);
-    if (sound_cues != 0)
-    {
-        std::cout << "actually sending sound cue" << static_cast<int>(sound_cues) << std::endl;
-    }
-};
-
-void NetworkObject::receive(uint32_t *at, std::vector<uint8_t> &recv_buffer)
-{
-    auto read = [&](auto *val)
-    {
-        std::memcpy(val, &recv_buffer[4 + *at], sizeof(*val));
-        *at += sizeof(*val);
-    };
-    read(&id);
-    read(&type);
-    read(&position);
-    read(&velocity);
-    read(&scale);
-    read(&deleted);
-    read(&sound_cues);
-    if (sound_cues != 0)
-    {
-        // std::cout<<"actually receiving sound cue"<<static_cast<int>(sound_cues)<<std::endl;
-    }
-};
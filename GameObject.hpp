@@ -1,10 +1,12 @@
 #pragma once
 #include "Connection.hpp"
 #include "BBox.hpp"
+#include "BitStream.hpp"
 #include "Raycast.hpp"
 
 #include <iostream>
 #include <glm/glm.hpp>
+#include <functional>
 #include <string>
 #include <list>
 #include <vector>
@@ -60,6 +62,14 @@ struct NetworkObject : GameObject
     // common
     uint32_t id;
 
+    // how the synced fields are packed into state messages:
+    //   positions cover the level (prototype.scene spans about x -97..95, y -220..220) with room to spare,
+    //   speeds stay well under Torpedo::TORPEDO_SPEED * 2
+    static constexpr Quantizer PositionX{-128.0f, 1.0f / 256.0f, 16};
+    static constexpr Quantizer PositionY{-256.0f, 1.0f / 256.0f, 17};
+    static constexpr Quantizer VelocityAxis{-32.0f, 1.0f / 256.0f, 14};
+    static constexpr Quantizer ScaleAxis{0.0f, 1.0f / 1024.0f, 16};
+
     uint8_t sound_cues = 0;
     // server side function to add a cue to send
     void add_sound_cue(uint8_t s)
@@ -73,19 +83,52 @@ struct NetworkObject : GameObject
     // it will be deleted at the end of this frame
     bool deleted = false;
 
+    // server only, set by fast movers that could tunnel through thin objects in one tick;
+    // move_with_collision then sweeps the box and stops at the first hit instead of pushing out
+    bool continuous_collision = false;
+    static constexpr float ContactSkin = 0.01f;
+
+    // server only, where update() moved this object to; copied into 'position' once every object has updated
+    glm::vec2 next_position = glm::vec2(0.0f, 0.0f);
+
+    /**
+     * Server only. update() runs in parallel against the world as it was at the start of the tick,
+     * so it may only change this object's own state. Anything that touches another object,
+     * spawns, or changes the level is queued here with defer() and applied by Game::update
+     * afterwards, one object at a time in id order.
+     */
+    std::vector<std::function<void(Game *)>> deferred;
+    template <typename F>
+    void defer(F &&f)
+    {
+        deferred.emplace_back(std::forward<F>(f));
+    }
+
+    // server only, index of this object's slot in its ObjectPool
+    uint32_t pool_slot = 0;
+    // server only, this object's leaf in Game::dynamic_bvh
+    uint32_t proxy = DynamicBVH::Null;
+
     NetworkObject() {};
     virtual ~NetworkObject() {};
     virtual void init() override;
     void gather_collision_candidates(Game *game, const BBox &sweepBox, std::vector<GameObject *> &out);
+    void gather_collision_candidates(BVH &statics, DynamicBVH const &dynamics, const BBox &sweepBox, std::vector<GameObject *> &out);
     /**
      * 0: collide check fail, don't collide with the other
      * 1: can collide, can't move into the other
      * 2: can collide, and can move into the other
      */
     virtual int can_collide(const NetworkObject *other) const;
-    std::vector<GameObject *> move_with_collision(Game *game, glm::vec2 movement);
-    void send(Connection *connection) const;
-    void receive(uint32_t *at, std::vector<uint8_t> &recv_buffer);
+    // false if can_collide() returns 0 for every object of this type, so the whole type can be skipped
+    virtual bool can_collide_with(ObjectType type) const { return false; }
+    // moves next_position; 'contact' (optional) receives the earliest hit and its normal for continuous_collision movers
+    std::vector<GameObject *> move_with_collision(Game *game, glm::vec2 movement, Trace *contact = nullptr);
+    // earliest object this box would hit moving by 'movement'; distance is measured along 'movement'
+    Trace sweep(Game *game, glm::vec2 movement) const;
+    // the same against any static and dynamic trees (clients predict their own sub against their copies of the world):
+    std::vector<GameObject *> move_with_collision(BVH &statics, DynamicBVH const &dynamics, glm::vec2 movement, Trace *contact = nullptr);
+    Trace sweep(BVH const &statics, DynamicBVH const &dynamics, glm::vec2 movement) const;
 };
 
 // used to represent a control input:
@@ -118,13 +161,12 @@ struct Player : NetworkObject
         Button left, right, up, down, jump;
         Button radar, light, rotate_left, rotate_right;
         Button num1, num2, num3, num4;
+        // input number, one per client tick (see InputSender); on the server, the input applied this tick
+        //   (state messages echo it back, so a predicting client knows which inputs the server has seen)
+        uint32_t sequence = 0;
 
-        void send_controls_message(Connection *connection) const;
-
-        // returns 'false' if no message or not a controls message,
-        // returns 'true' if read a controls message,
-        // throws on malformed controls message
-        bool recv_controls_message(Connection *connection);
+        // unit-ish steering direction from the arrow buttons (zero if none are held):
+        glm::vec2 direction() const;
     } controls;
 
     // additional player data
@@ -154,15 +196,25 @@ struct Player : NetworkObject
         bool light_on = true;
         bool player_facing = false; // false is left, true is right
 
-        void send(Connection *connection) const;
-        void receive(uint32_t *at, std::vector<uint8_t> &recv_buffer);
+        static constexpr Quantizer TorpedoTimer{0.0f, 1.0f / 64.0f, 8};
+        static constexpr Quantizer Health{0.0f, 1.0f / 8.0f, 10};
+
+        void send(BitWriter &writer) const;
+        void receive(BitReader &reader);
+        // true if send() would write the same thing for both:
+        bool synced_equals(PlayerData const &other) const;
     } data;
 
     virtual void init() override;
     virtual int can_collide(const NetworkObject *other) const override;
+    virtual bool can_collide_with(ObjectType type) const override;
     virtual void update(float elapsed, Game *game) override;
     void update_weapon(float elapsed, Game *game);
     void update_movement(float elapsed, Game *game);
+    // the deterministic part of update_movement, also run by clients to predict their own sub:
+    //   steers velocity toward controls, moves (into next_position) through the given trees, and stops at obstacles.
+    //   Returns what was hit; what that means (flags, damage) is up to the server.
+    std::vector<GameObject *> step_movement(float elapsed, BVH &statics, DynamicBVH const &dynamics);
     void update_control(float elapsed, Game *game);
     void update_win_lose(float elapsed, Game *game);
     void take_damage(Game *game, float damage, GameObject *source);
@@ -184,6 +236,7 @@ struct Torpedo : NetworkObject
     float age;
 
     virtual int can_collide(const NetworkObject *other) const override;
+    virtual bool can_collide_with(ObjectType type) const override { return true; }
     virtual void update(float elapsed, Game *game) override;
     virtual void init() override;
 };
@@ -0,0 +1,226 @@
+#include "Input.hpp"
+
+#include "Connection.hpp"
+#include "Game.hpp"
+#include "Wire.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    constexpr uint32_t ButtonCount = 13;
+
+    // the buttons, in the order they go on the wire:
+    template <typename C>
+    auto buttons(C &c)
+    {
+        return std::array{&c.left, &c.right, &c.up, &c.down, &c.jump, &c.radar, &c.light,
+                          &c.num1, &c.num2, &c.num3, &c.num4, &c.rotate_left, &c.rotate_right};
+    }
+    static_assert(std::tuple_size<decltype(buttons(std::declval<Player::Controls &>()))>::value == ButtonCount);
+
+    void add_downs(Player::Controls *to, Player::Controls const &from)
+    {
+        auto t = buttons(*to);
+        auto f = buttons(from);
+        for (uint32_t i = 0; i < ButtonCount; ++i)
+            t[i]->downs = uint8_t(std::min(255u, uint32_t(t[i]->downs) + uint32_t(f[i]->downs)));
+    }
+
+    void clear_downs(Player::Controls *controls)
+    {
+        for (Button *b : buttons(*controls))
+            b->downs = 0;
+    }
+
+    // does 'input' press or release anything, compared to 'before'?
+    bool changes(Player::Controls const &input, Player::Controls const &before)
+    {
+        auto a = buttons(input);
+        auto b = buttons(before);
+        for (uint32_t i = 0; i < ButtonCount; ++i)
+            if (a[i]->downs != 0 || a[i]->pressed != b[i]->pressed)
+                return true;
+        return false;
+    }
+}
+
+uint32_t InputSender::update(float elapsed, Player::Controls const &frame)
+{
+    add_downs(&building, frame);
+    auto b = buttons(building);
+    auto f = buttons(frame);
+    for (uint32_t i = 0; i < ButtonCount; ++i)
+        b[i]->pressed = f[i]->pressed;
+
+    // (after a long hitch, let the client fall behind rather than send a burst of identical inputs)
+    accumulator = std::min(accumulator + elapsed, float(MaxBatch) * Game::Tick);
+    uint32_t completed = 0;
+    while (accumulator >= Game::Tick)
+    {
+        accumulator -= Game::Tick;
+        sequence += 1;
+        building.sequence = sequence;
+        if (changes(building, previous))
+            changed = true;
+        previous = building;
+        unacked.emplace_back(building);
+        if (unacked.size() > MaxUnacked)
+            unacked.pop_front();
+        clear_downs(&building);
+        completed += 1;
+    }
+    return completed;
+}
+
+void InputSender::acknowledge(uint32_t sequence_)
+{
+    while (!unacked.empty() && int32_t(unacked.front().sequence - sequence_) <= 0)
+        unacked.pop_front();
+}
+
+void InputSender::send_controls_message(Connection *connection_)
+{
+    assert(connection_);
+    auto &connection = *connection_;
+
+    if (sequence == sent || unacked.empty())
+        return;
+    if (!changed && sequence - sent < HeartbeatTicks)
+        return;
+
+    uint32_t count = uint32_t(std::min<size_t>(unacked.size(), MaxBatch));
+    ByteQueue body;
+    Wire::write_varint(body, sequence);
+    body.push_back(uint8_t(count));
+    for (size_t i = unacked.size() - count; i < unacked.size(); ++i)
+    {
+        for (Button const *b : buttons(unacked[i]))
+        {
+            if (b->downs & 0x80)
+            {
+                std::cerr << "Wow, you are really good at pressing buttons!" << std::endl;
+            }
+            body.push_back(uint8_t((b->pressed ? 0x80 : 0x00) | std::min<uint8_t>(b->downs, 0x7f)));
+        }
+    }
+
+    Wire::send(connection.send_buffer, uint8_t(Message::C2S_Controls), body);
+    sent = sequence;
+    changed = false;
+}
+
+bool InputBuffer::recv_controls_message(Connection *connection_)
+{
+    assert(connection_);
+    auto &connection = *connection_;
+    auto &recv_buffer = connection.recv_buffer;
+
+    // expecting a complete [type, size, body] message (see Wire):
+    Wire::Frame frame;
+    if (!Wire::peek(recv_buffer, 0, &frame) || frame.type != uint8_t(Message::C2S_Controls))
+        return false;
+    size_t at = frame.header;
+    size_t end = frame.total();
+    uint32_t newest = Wire::read_varint(recv_buffer, at, end);
+    if (at >= end)
+        throw std::runtime_error("Controls message without an input count.");
+    uint32_t count = recv_buffer[at++];
+    if (count == 0 || count > InputSender::MaxBatch)
+        throw std::runtime_error("Controls message with " + std::to_string(count) + " inputs.");
+    if (end - at != count * ButtonCount)
+        throw std::runtime_error("Controls message with " + std::to_string(end - at) + " bytes for " + std::to_string(count) + " inputs.");
+    if (newest < count)
+        throw std::runtime_error("Controls message with bad sequence " + std::to_string(newest) + ".");
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Player::Controls input;
+        input.sequence = newest - count + 1 + i;
+        for (Button *b : buttons(input))
+        {
+            uint8_t byte = recv_buffer[at++];
+            b->pressed = (byte & 0x80);
+            b->downs = byte & 0x7f;
+        }
+
+        // (batches overlap, so most inputs have been seen before)
+        if (started && int32_t(input.sequence - received) <= 0)
+            continue;
+        if (!started)
+        {
+            started = true;
+            applied = input.sequence > Depth ? input.sequence - Depth - 1 : 0;
+        }
+        received = input.sequence;
+        ticks_since = 0;
+
+        if (int32_t(input.sequence - applied) <= 0)
+        {
+            // too late for its tick; keep what it says for the next one:
+            add_downs(&carry, input);
+            held = input;
+        }
+        else
+        {
+            if (inputs.size() == MaxInputs)
+            {
+                add_downs(&carry, inputs.front());
+                inputs.pop_front();
+            }
+            inputs.emplace_back(input);
+        }
+    }
+
+    // delete message from buffer:
+    recv_buffer.consume(frame.total());
+
+    return true;
+}
+
+void InputBuffer::next(Player::Controls *controls)
+{
+    if (!started)
+        return;
+    ticks_since += 1;
+
+    // where the client's inputs should be by now:
+    uint32_t target = received + ticks_since - Depth;
+    uint32_t sequence = applied + 1;
+    int32_t drift = int32_t(sequence - target);
+    if (drift > int32_t(Resync))
+        sequence = applied; // ahead of the client: wait a tick
+    else if (drift < -int32_t(Resync))
+        sequence = target; // behind (e.g., after a stall): skip ahead
+
+    // inputs from before this tick can't be applied any more, but their presses still count:
+    while (!inputs.empty() && int32_t(inputs.front().sequence - sequence) < 0)
+    {
+        add_downs(&carry, inputs.front());
+        held = inputs.front();
+        inputs.pop_front();
+    }
+
+    Player::Controls input;
+    if (!inputs.empty() && inputs.front().sequence == sequence)
+    {
+        input = inputs.front();
+        inputs.pop_front();
+    }
+    else
+    {
+        input = held;
+        clear_downs(&input);
+    }
+    input.sequence = sequence;
+    add_downs(&input, carry);
+    clear_downs(&carry);
+
+    held = input;
+    applied = sequence;
+    *controls = input;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "GameObject.hpp"
+
+#include <deque>
+
+struct Connection;
+
+/**
+ * The client's half of C2S_Controls.
+ * Buttons are sampled once per Game::Tick of client time, and each sample (an "input") gets the next
+ * sequence number, so input N is what the player did during the client's tick N.
+ * Messages only go out when an input presses or releases something, or every HeartbeatTicks otherwise,
+ * and each one carries every input the server hasn't acknowledged yet (up to MaxBatch, oldest first),
+ * so a lost or late message is covered by the next.
+ *   C2S_Controls body: [newest sequence: varint][count: 1 byte][count inputs, 13 bytes each]
+ */
+struct InputSender
+{
+    static constexpr uint32_t HeartbeatTicks = 3; // (10 Hz while nothing changes)
+    static constexpr uint32_t MaxBatch = 8;
+    static constexpr size_t MaxUnacked = 256; // (about eight seconds with no word from the server)
+
+    // fold in one frame of buttons ('downs' counting this frame's presses) and advance the clock;
+    // returns how many inputs that completed (they are the newest ones in 'unacked')
+    uint32_t update(float elapsed, Player::Controls const &frame);
+    // the server has applied everything up to 'sequence' (see Snapshot::input_sequence):
+    void acknowledge(uint32_t sequence);
+    // queue a controls message, if anything changed or the heartbeat is due:
+    void send_controls_message(Connection *connection);
+
+    std::deque<Player::Controls> unacked; // completed inputs the server hasn't applied, oldest first
+    Player::Controls building;            // the tick in progress
+    Player::Controls previous;            // the newest completed input
+    float accumulator = 0.0f;             // client time into the tick in progress
+    uint32_t sequence = 0;                // of the newest completed input
+    uint32_t sent = 0;                    // newest sequence sent
+    bool changed = false;                 // some unsent input pressed or released something
+};
+
+/**
+ * The server's half of C2S_Controls, for one connection: a short jitter buffer in front of Player::controls.
+ * Inputs are applied one per tick, in sequence order, Depth ticks behind the newest one heard of
+ * (plus the ticks since), so a message that is a little early or late still lands on its tick.
+ * An input that hasn't arrived by its tick is taken to hold the buttons as last known
+ * (clients don't send unchanged inputs); presses in inputs that arrive too late carry into the next tick.
+ * If the client's clock drifts more than Resync ticks from that schedule, the buffer waits or skips to catch up.
+ */
+struct InputBuffer
+{
+    static constexpr uint32_t Depth = 2;
+    static constexpr uint32_t Resync = 4;
+    static constexpr size_t MaxInputs = 32;
+
+    // returns 'false' if no message or not a controls message,
+    // returns 'true' if read a controls message,
+    // throws on malformed controls message
+    bool recv_controls_message(Connection *connection);
+
+    // the input for this tick (leaves 'controls' alone until the first input arrives):
+    void next(Player::Controls *controls);
+
+    std::deque<Player::Controls> inputs; // received but not applied, by increasing sequence
+    Player::Controls held;               // buttons of the newest known input at or before 'applied'
+    Player::Controls carry;              // presses from inputs that came too late, for the next tick
+    uint32_t received = 0;               // newest sequence received
+    uint32_t ticks_since = 0;            // ticks since 'received' advanced
+    uint32_t applied = 0;                // sequence applied last tick
+    bool started = false;
+};
@@ -0,0 +1,90 @@
+#include "Interpolator.hpp"
+
+#include "Game.hpp"
+
+#include <algorithm>
+
+void Interpolator::advance(float elapsed)
+{
+    now += elapsed;
+    offset += OffsetDrift * elapsed;
+
+    // a message is due every tick, and each can be up to a couple of jitters late:
+    float target = std::clamp(Game::Tick + 2.0f * jitter, Game::Tick, MaxDelay);
+    float step = DelaySlew * elapsed;
+    delay += std::clamp(target - delay, -step, step);
+}
+
+void Interpolator::begin(uint32_t sequence)
+{
+    message_time = double(sequence) * double(Game::Tick);
+    double lateness = (now - message_time) - offset;
+    if (!started)
+    {
+        started = true;
+        offset = now - message_time;
+        lateness = 0.0;
+    }
+    else if (lateness < 0.0)
+    {
+        // earliest arrival yet:
+        offset += lateness;
+        lateness = 0.0;
+    }
+    jitter += (float(lateness) - jitter) * JitterSmoothing;
+}
+
+void Interpolator::record(uint32_t id, glm::vec2 position, glm::vec2 velocity)
+{
+    Track &track = tracks[id];
+    // (an older message that arrived late has nothing to add)
+    if (track.count > 0 && message_time <= track.back(0).time)
+        return;
+    track.newest = (track.newest + 1) % Track::Size;
+    track.count = std::min(track.count + 1, Track::Size);
+    track.samples[track.newest] = Sample{message_time, position, velocity};
+}
+
+void Interpolator::forget(uint32_t id)
+{
+    tracks.erase(id);
+}
+
+bool Interpolator::sample(uint32_t id, glm::vec2 *position) const
+{
+    auto f = tracks.find(id);
+    if (f == tracks.end() || f->second.count == 0)
+        return false;
+    Track const &track = f->second;
+    double time = render_time();
+
+    // past the newest sample: extrapolate (for a while):
+    Sample const &newest = track.back(0);
+    if (time >= newest.time)
+    {
+        float ahead = float(std::min(time - newest.time, double(MaxExtrapolation)));
+        *position = newest.position + newest.velocity * ahead;
+        return true;
+    }
+
+    // otherwise blend the two samples around 'time':
+    for (uint32_t age = 1; age < track.count; ++age)
+    {
+        Sample const &before = track.back(age);
+        if (before.time > time)
+            continue;
+        Sample const &after = track.back(age - 1);
+        float span = float(after.time - before.time);
+        float t = float(time - before.time) / span;
+        float moved = glm::length(after.position - before.position);
+        if (moved > 0.5f * (glm::length(before.velocity) + glm::length(after.velocity)) * span + SnapDistance)
+            *position = before.position;
+        else
+            *position = glm::mix(before.position, after.position, t);
+        return true;
+    }
+
+    // before the oldest sample:
+    *position = track.back(track.count - 1).position;
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+
+/**
+ * Client-side smoothing for objects the client doesn't control.
+ * State messages arrive once per server tick (give or take network timing), so drawing
+ * their positions as they come stutters. Instead, received positions are buffered per object
+ * with the server time they were captured at, and drawn 'delay' seconds in the past,
+ * interpolating between the two samples around that time.
+ *
+ * The server doesn't send its clock, but it sends one state message per tick to each client,
+ * so a message's sequence number times Game::Tick is its server time.
+ * The delay adapts to how late messages arrive compared to the earliest one seen:
+ * about one tick plus a couple of jitters, so there is usually a sample past the drawn time.
+ * If there isn't (a late or dropped message), the newest sample is extrapolated with its velocity for a while.
+ */
+struct Interpolator
+{
+    // advance the client clock (once per frame):
+    void advance(float elapsed);
+
+    // a state message with the given sequence number just arrived; updates the delay estimate:
+    void begin(uint32_t sequence);
+    // ...and it had object 'id' here:
+    void record(uint32_t id, glm::vec2 position, glm::vec2 velocity);
+    // the object went away:
+    void forget(uint32_t id);
+
+    // where to draw object 'id' now (false if nothing was recorded for it):
+    bool sample(uint32_t id, glm::vec2 *position) const;
+
+    // the server time being drawn:
+    double render_time() const { return now - offset - delay; }
+
+    static constexpr float MaxDelay = 0.25f;
+    static constexpr float MaxExtrapolation = 0.25f;       // after this much past the newest sample, hold still
+    static constexpr float JitterSmoothing = 1.0f / 16.0f; // weight of each new lateness measurement
+    static constexpr float DelaySlew = 0.1f;               // delay seconds gained or lost per second, so drawn time never jumps
+    static constexpr float OffsetDrift = 0.01f;            // how fast the earliest-arrival estimate forgets (seconds per second)
+    static constexpr float SnapDistance = 4.0f;            // samples further apart than motion explains (respawns) aren't blended
+
+    struct Sample
+    {
+        double time = 0.0; // server time
+        glm::vec2 position = glm::vec2(0.0f);
+        glm::vec2 velocity = glm::vec2(0.0f);
+    };
+    struct Track
+    {
+        static constexpr uint32_t Size = 8; // (MaxDelay is under eight ticks)
+        std::array<Sample, Size> samples;
+        uint32_t newest = 0; // index of the newest sample
+        uint32_t count = 0;
+
+        Sample const &back(uint32_t age) const { return samples[(newest + Size - age) % Size]; }
+    };
+    std::unordered_map<uint32_t, Track> tracks;
+
+    double now = 0.0;           // client clock
+    double offset = 0.0;        // client clock minus server time for the earliest arrivals
+    bool started = false;       // offset has been measured
+    float jitter = 0.0f;        // smoothed lateness past 'offset'
+    float delay = 0.1f;
+    double message_time = 0.0;  // server time of the message being recorded
+};
@@ -29,30 +29,23 @@ struct Level
             revealed_objects.end());
     }
 
-    void send(Connection *connection) const
+    void send(BitWriter &writer) const
     {
-        connection->send(uint8_t(revealed_objects.size()));
+        writer.write_varbits(uint32_t(revealed_objects.size()));
         for (auto ro : revealed_objects)
         {
-            connection->send(ro.obj_id);
+            writer.write_varbits(ro.obj_id);
         }
     }
 
-    void receive(uint32_t *at, std::vector<uint8_t> &recv_buffer)
+    void receive(BitReader &reader)
     {
-        auto read = [&](auto *val)
-        {
-            std::memcpy(val, &recv_buffer[4 + *at], sizeof(*val));
-            *at += sizeof(*val);
-        };
-
         revealed_objects.clear();
-        uint8_t ro_count;
-        read(&ro_count);
-        for (int i = 0; i < ro_count; i++)
+        uint32_t ro_count = reader.read_varbits();
+        for (uint32_t i = 0; i < ro_count; i++)
         {
             RevealedObject obj;
-            read(&obj.obj_id);
+            obj.obj_id = reader.read_varbits();
             obj.age = 0;
             obj.duration = 0;
             revealed_objects.push_back(obj);
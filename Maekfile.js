@@ -161,13 +161,16 @@ const client_names = [
     maek.CPP('load_opus.cpp'),
     maek.CPP('TextEngine.cpp'),
     maek.CPP('Radar.cpp'),
+    maek.CPP('Interpolator.cpp'),
     maek.CPP('UI.cpp'),
     maek.CPP('Registry.cpp')
 
 ];
 
 const server_names = [
-    maek.CPP('server.cpp')
+    maek.CPP('server.cpp'),
+    maek.CPP('MatchHost.cpp'),
+    maek.CPP('TickProfiler.cpp')
 ];
 
 const common_names = [
@@ -185,15 +188,37 @@ const common_names = [
     maek.CPP('GL.cpp'),
     maek.CPP('Load.cpp'),
     maek.CPP('Connection.cpp'),
+    maek.CPP('ByteQueue.cpp'),
+    maek.CPP('Wire.cpp'),
+    maek.CPP('Input.cpp'),
     maek.CPP('GameObject.cpp'),
     maek.CPP('Raycast.cpp'),
     maek.CPP('BBox.cpp'),
     maek.CPP('Player.cpp'),
     maek.CPP('Flag.cpp'),
     maek.CPP('Torpedo.cpp'),
+    maek.CPP('WorkerPool.cpp'),
+    maek.CPP('Snapshot.cpp'),
+    maek.CPP('BitStream.cpp'),
     maek.CPP('hex_dump.cpp')
 ];
 
+const loadgen_names = [
+    maek.CPP('loadgen.cpp')
+];
+
+const bench_tick_names = [
+    maek.CPP('bench-tick.cpp')
+];
+
+const bench_poll_names = [
+    maek.CPP('bench-poll.cpp')
+];
+
+const netsim_names = [
+    maek.CPP('netsim.cpp')
+];
+
 const show_meshes_names = [
     maek.CPP('show-meshes.cpp'),
     maek.CPP('ShowMeshesProgram.cpp'),
@@ -212,11 +237,19 @@ const show_scene_names = [
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
 const client_exe = maek.LINK([...client_names, ...common_names], 'dist/client');
 const server_exe = maek.LINK([...server_names, ...common_names], 'dist/server');
+const loadgen_exe = maek.LINK([...loadgen_names, ...common_names], 'dist/loadgen');
+const bench_tick_exe = maek.LINK([...bench_tick_names, ...common_names], 'dist/bench-tick');
+const bench_poll_exe = maek.LINK([...bench_poll_names, ...common_names], 'dist/bench-poll');
+const netsim_exe = maek.LINK([...netsim_names], 'dist/netsim');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [client_exe, server_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [client_exe, server_exe, loadgen_exe, bench_tick_exe, show_meshes_exe, show_scene_exe, ...copies];
+//bench-poll and netsim use POSIX sockets (and bench-poll rlimits) directly:
+if (maek.OS === 'linux') {
+    maek.TARGETS.push(bench_poll_exe, netsim_exe);
+}
 
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
@@ -0,0 +1,286 @@
+#include "MatchHost.hpp"
+#include "Wire.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <iomanip>
+
+void Match::tick()
+{
+    using Clock = std::chrono::steady_clock;
+    auto ms_since = [](Clock::time_point then)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - then).count();
+    };
+    auto before = Clock::now();
+    samples.clear();
+    bytes_queued = 0;
+    bytes_backlog = 0;
+
+    // this tick's input for every player:
+    for (auto &[c, player] : connection_to_player)
+        input_buffers.at(c).next(&player->controls);
+
+    // update current game state
+    game.update(Game::Tick);
+    if (game.profile)
+    {
+        samples.emplace_back(TickProfiler::Update, ms_since(before));
+        samples.emplace_back(TickProfiler::UpdatePlayer, game.update_ms[size_t(ObjectType::Player)]);
+        samples.emplace_back(TickProfiler::UpdateTorpedo, game.update_ms[size_t(ObjectType::Torpedo)]);
+        samples.emplace_back(TickProfiler::UpdateFlag, game.update_ms[size_t(ObjectType::Flag)]);
+    }
+
+    // capture the world once, then cut every client's snapshot from it
+    auto capture_start = Clock::now();
+    game.capture_frame();
+    if (game.profile)
+        samples.emplace_back(TickProfiler::Capture, ms_since(capture_start));
+
+    // send updated game state to all clients
+    for (auto &[c, player] : connection_to_player)
+    {
+        auto send_start = Clock::now();
+        size_t size_before = c->send_buffer.size();
+        game.send_state_message(c, player, snapshot_histories.at(c));
+        if (game.profile)
+        {
+            samples.emplace_back(TickProfiler::Send, ms_since(send_start));
+            bytes_queued += c->send_buffer.size() - size_before;
+            bytes_backlog += c->send_buffer.size();
+        }
+    }
+
+    auto sweep_start = Clock::now();
+    game.remove_deleted_objects();
+    if (game.profile)
+        samples.emplace_back(TickProfiler::Sweep, ms_since(sweep_start));
+
+    // reset sound_cue bits so no sound events occur it there are no sound events
+    game.for_each_object([](NetworkObject *g)
+                         { g->sound_cues = 0; });
+
+    tick_ms = ms_since(before);
+}
+
+MatchHost::MatchHost(std::shared_ptr<BVH> static_bvh_, uint32_t worker_threads, uint32_t players_per_match_)
+    : static_bvh(std::move(static_bvh_)), players_per_match(std::max(1u, players_per_match_)), workers(worker_threads)
+{
+}
+
+Match *MatchHost::find_open_match()
+{
+    for (auto it = matches.rbegin(); it != matches.rend(); ++it)
+    {
+        if ((*it)->connection_to_player.size() < players_per_match)
+            return it->get();
+    }
+
+    matches.emplace_back(std::make_unique<Match>());
+    Match *match = matches.back().get();
+    match->id = next_match_id++;
+    match->game.bvh = static_bvh;
+    match->game.profile = (profiler != nullptr);
+    stats.created += 1;
+    std::cout << "match " << match->id << " created (" << matches.size() << " running)" << std::endl;
+    return match;
+}
+
+void MatchHost::add_connection(Connection *c)
+{
+    Match *match = find_open_match();
+
+    // create some player info for them:
+    auto player = match->game.spawn_object<Player>();
+    match->game.init_player_spawn_info(player);
+    match->connection_to_player.emplace(c, player);
+    match->input_buffers.try_emplace(c);
+    match->snapshot_histories.try_emplace(c);
+    connection_to_match.emplace(c, match);
+}
+
+void MatchHost::remove_connection(Connection *c)
+{
+    if (greeting.erase(c))
+        return;
+
+    // (a connection can be closed twice, e.g. by a malformed message and then by the poller)
+    auto f = connection_to_match.find(c);
+    if (f == connection_to_match.end())
+        return;
+    Match *match = f->second;
+    connection_to_match.erase(f);
+
+    auto p = match->connection_to_player.find(c);
+    assert(p != match->connection_to_player.end());
+    p->second->deleted = true;
+    match->connection_to_player.erase(p);
+    match->input_buffers.erase(c);
+    match->snapshot_histories.erase(c);
+}
+
+void MatchHost::on_event(Connection *c, Connection::Event evt)
+{
+    if (evt == Connection::OnOpen)
+    {
+        // client connected; it joins a match once the handshake is done:
+        greeting.emplace(c);
+    }
+    else if (evt == Connection::OnClose)
+    {
+        // client disconnected:
+        remove_connection(c);
+    }
+    else
+    {
+        assert(evt == Connection::OnRecv);
+        // got data from client:
+        try
+        {
+            if (greeting.count(c))
+            {
+                if (!Game::recv_hello_message(c))
+                    return;
+                greeting.erase(c);
+                Game::send_welcome_message(c);
+                add_connection(c);
+            }
+
+            // look up in players list:
+            auto f = connection_to_match.find(c);
+            assert(f != connection_to_match.end());
+            InputBuffer &inputs = f->second->input_buffers.at(c);
+            SnapshotHistory &history = f->second->snapshot_histories.at(c);
+
+            // handle messages from client:
+            bool handled_message;
+            do
+            {
+                handled_message = false;
+                if (inputs.recv_controls_message(c))
+                    handled_message = true;
+                if (history.recv_ack_message(c))
+                    handled_message = true;
+                // TODO: extend for more message types as needed
+            } while (handled_message);
+
+            // a whole message none of the above understood:
+            Wire::Frame frame;
+            if (Wire::peek(c->recv_buffer, 0, &frame))
+                throw std::runtime_error("Unexpected message type " + std::to_string(int(frame.type)) + ".");
+        }
+        catch (std::exception const &e)
+        {
+            std::cout << "Disconnecting client:" << e.what() << std::endl;
+            c->close();
+            remove_connection(c);
+        }
+    }
+}
+
+void MatchHost::tick()
+{
+    auto before = std::chrono::steady_clock::now();
+
+    // only one parallel_for can run on the pool at a time, so either the matches or their objects get split up:
+    bool per_object = false;
+    if (matches.size() < workers.thread_count())
+        for (auto const &match : matches)
+            per_object = per_object || match->game.object_count() >= ParallelObjects;
+
+    if (per_object)
+    {
+        // a few matches, at least one big one: tick them in turn, big ones spreading their objects across the pool
+        for (auto &match : matches)
+        {
+            match->game.workers = (match->game.object_count() >= ParallelObjects ? &workers : nullptr);
+            match->tick();
+        }
+    }
+    else
+    {
+        // matches don't share any mutable state, so each one is a job:
+        for (auto &match : matches)
+            match->game.workers = nullptr;
+        workers.parallel_for(matches.size(), [&](size_t i)
+                             { matches[i]->tick(); }, 1);
+    }
+
+    size_t bytes_queued = 0;
+    size_t bytes_backlog = 0;
+    for (auto const &match : matches)
+    {
+        stats.match_ms += match->tick_ms;
+        stats.match_ticks += 1;
+        if (profiler)
+        {
+            for (auto const &[phase, ms] : match->samples)
+                profiler->record(phase, ms);
+            bytes_queued += match->bytes_queued;
+            bytes_backlog += match->bytes_backlog;
+        }
+    }
+
+    // tear down matches everyone has left (after the tick, so their last deletions were swept):
+    auto empty = std::remove_if(matches.begin(), matches.end(), [&](std::unique_ptr<Match> const &match)
+                                {
+        if (!match->connection_to_player.empty())
+            return false;
+        std::cout << "match " << match->id << " torn down" << std::endl;
+        stats.torn_down += 1;
+        return true; });
+    matches.erase(empty, matches.end());
+
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - before).count();
+    stats.ticks += 1;
+    stats.tick_wall_ms += wall_ms;
+    if (profiler)
+    {
+        profiler->record_bytes(bytes_queued, bytes_backlog);
+        profiler->end_tick(wall_ms, 1000.0 * Game::Tick);
+    }
+
+    if (std::chrono::duration<double>(std::chrono::steady_clock::now() - stats_start).count() >= StatsInterval)
+        report_stats();
+}
+
+void MatchHost::report_stats()
+{
+    size_t memory = 0;
+    for (auto const &match : matches)
+        memory += match->game.memory_usage();
+
+    double wall = stats.ticks ? stats.tick_wall_ms / stats.ticks : 0.0;
+    double per_match = stats.match_ticks ? stats.match_ms / stats.match_ticks : 0.0;
+    // whatever part of the wall time the matches themselves don't explain, spread over the matches:
+    double busy = stats.ticks ? stats.match_ms / stats.ticks / workers.thread_count() : 0.0;
+    double matches_per_tick = stats.ticks ? double(stats.match_ticks) / stats.ticks : 0.0;
+    double overhead = matches_per_tick > 0.0 ? std::max(0.0, wall - busy) / matches_per_tick : 0.0;
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "[matches] " << matches.size() << " running (+" << stats.created << " -" << stats.torn_down << "), "
+              << connection_to_match.size() << " connections; "
+              << "tick " << wall << " ms on " << workers.thread_count() << " threads, "
+              << per_match << " ms/match, " << overhead * 1000.0 << " us scheduling/match, "
+              << (matches.empty() ? 0 : memory / matches.size() / 1024) << " KiB/match" << std::endl;
+
+    // clients that couldn't keep up since the last report:
+    uint32_t behind = 0;
+    for (auto const &[c, match] : connection_to_match)
+    {
+        if (c->backlog.replaced != 0)
+        {
+            behind += 1;
+            std::cout << "[backlog] connection " << c->socket << " (match " << match->id << "): peak "
+                      << c->backlog.peak / 1024 << " KiB unsent, " << c->send_buffer.size() / 1024 << " KiB now, "
+                      << c->backlog.replaced << " stale states dropped" << std::endl;
+        }
+        c->backlog = Connection::Backlog();
+    }
+    if (behind > 0)
+        std::cout << "[backlog] " << behind << " of " << connection_to_match.size() << " connections fell behind" << std::endl;
+
+    stats = Stats();
+    stats_start = std::chrono::steady_clock::now();
+}
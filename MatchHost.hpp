@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Connection.hpp"
+#include "Game.hpp"
+#include "Input.hpp"
+#include "TickProfiler.hpp"
+#include "WorkerPool.hpp"
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/**
+ * One match: its own Game and the connections playing in it.
+ */
+struct Match
+{
+    uint32_t id = 0;
+    Game game;
+    // keep track of which connection is controlling which player:
+    std::unordered_map<Connection *, Player *> connection_to_player;
+    // inputs received from each connection, fed to its player one per tick:
+    std::unordered_map<Connection *, InputBuffer> input_buffers;
+    // snapshots sent to each connection, to diff the next one against:
+    std::unordered_map<Connection *, SnapshotHistory> snapshot_histories;
+
+    // time the last tick of this match took (update + send + sweep), in milliseconds:
+    double tick_ms = 0.0;
+    // per-phase timings and send buffer sizes from the last tick, filled when 'game.profile' is set;
+    // the host merges them into its profiler once every match has ticked:
+    std::vector<std::pair<TickProfiler::Phase, double>> samples;
+    size_t bytes_queued = 0;
+    size_t bytes_backlog = 0;
+
+    void tick();
+};
+
+/**
+ * Runs many independent matches in one server process.
+ * New connections join the newest match with a free seat, or a new match is created
+ * for them; a match is torn down once its last connection leaves.
+ * Every match shares the same (read only) static obstacle BVH, and each tick the
+ * matches are spread across a fixed WorkerPool, one match per job.
+ * With fewer matches than threads that would leave threads idle, so then the matches tick one
+ * after another instead, and those with at least ParallelObjects objects split their per-object
+ * update phase across the pool (Game::workers). Only that phase is parallel in this mode.
+ */
+struct MatchHost
+{
+    MatchHost(std::shared_ptr<BVH> static_bvh, uint32_t worker_threads, uint32_t players_per_match);
+
+    // pass Server::poll events through here:
+    void on_event(Connection *c, Connection::Event evt);
+    // update every match, send its state to its connections, and drop empty matches:
+    void tick();
+
+    std::shared_ptr<BVH> static_bvh;
+    uint32_t players_per_match;
+    std::vector<std::unique_ptr<Match>> matches;
+    std::unordered_map<Connection *, Match *> connection_to_match;
+    // connections that haven't said hello yet (they join a match once they have):
+    std::unordered_set<Connection *> greeting;
+    WorkerPool workers;
+    // if set, every match is profiled and its phases recorded here each tick:
+    TickProfiler *profiler = nullptr;
+
+    // measurements, printed and reset every StatsInterval:
+    struct Stats
+    {
+        uint32_t ticks = 0;
+        double tick_wall_ms = 0.0;  // time spent in tick(), summed over ticks
+        double match_ms = 0.0;      // time spent inside Match::tick, summed over matches and ticks
+        size_t match_ticks = 0;     // number of Match::tick calls
+        uint32_t created = 0, torn_down = 0;
+    } stats;
+    std::chrono::steady_clock::time_point stats_start = std::chrono::steady_clock::now();
+    inline static constexpr double StatsInterval = 5.0; // seconds
+    // smaller matches update serially even when threads are free (handing out batches would cost more than it saves):
+    inline static constexpr size_t ParallelObjects = 256;
+    void report_stats();
+
+private:
+    uint32_t next_match_id = 1;
+    Match *find_open_match();
+    void add_connection(Connection *c);
+    void remove_connection(Connection *c);
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+/**
+ * Non-owning view of a run of Base pointers that are known to point at O.
+ * Used to hand out typed views of a pool's live list without copying it.
+ */
+template <typename O, typename Base>
+struct ObjectSpan
+{
+    std::span<Base *const> items;
+
+    struct iterator
+    {
+        Base *const *at;
+        O *operator*() const { return static_cast<O *>(*at); }
+        iterator &operator++()
+        {
+            ++at;
+            return *this;
+        }
+        bool operator!=(iterator const &other) const { return at != other.at; }
+        bool operator==(iterator const &other) const { return at == other.at; }
+    };
+
+    iterator begin() const { return iterator{items.data()}; }
+    iterator end() const { return iterator{items.data() + items.size()}; }
+    O *operator[](size_t i) const { return static_cast<O *>(items[i]); }
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+};
+
+/**
+ * Slab storage for one type of NetworkObject.
+ * Objects live in fixed-size chunks, so pointers stay valid while the pool grows.
+ * Deleted objects give their slot back to a free list and the next spawn reuses it.
+ * 'live' is a dense list of the objects currently in use, for iteration; it is
+ * stored as Base pointers so pools of different types can be viewed uniformly.
+ */
+template <typename O, typename Base = O>
+struct ObjectPool
+{
+    static constexpr uint32_t ChunkSize = 256;
+
+    // refers to a slot; becomes stale (get() returns nullptr) once the slot is recycled
+    struct Handle
+    {
+        uint32_t slot = 0xFFFFFFFFu;
+        uint32_t generation = 0;
+    };
+
+    std::vector<Base *> live;
+
+    ObjectSpan<O, Base> objects() const { return ObjectSpan<O, Base>{live}; }
+
+    // takes a slot from the free list (or grows the pool) and resets it to a fresh O
+    O *spawn()
+    {
+        uint32_t slot;
+        if (!free_slots.empty())
+        {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        else
+        {
+            slot = uint32_t(generations.size());
+            if (slot % ChunkSize == 0)
+                chunks.emplace_back(std::make_unique<O[]>(ChunkSize));
+            generations.push_back(0);
+            live_index.push_back(0);
+        }
+        O *obj = &at(slot);
+        *obj = O();
+        obj->pool_slot = slot;
+        live_index[slot] = uint32_t(live.size());
+        live.push_back(obj);
+        return obj;
+    }
+
+    // returns the object's slot to the free list; 'obj' must not be used afterwards
+    void recycle(Base *obj)
+    {
+        uint32_t slot = obj->pool_slot;
+        assert(slot < generations.size() && live[live_index[slot]] == obj);
+        // swap the last live object into the hole:
+        uint32_t index = live_index[slot];
+        live[index] = live.back();
+        live_index[live[index]->pool_slot] = index;
+        live.pop_back();
+
+        generations[slot] += 1;
+        free_slots.push_back(slot);
+    }
+
+    Handle get_handle(O const *obj) const
+    {
+        return Handle{obj->pool_slot, generations[obj->pool_slot]};
+    }
+
+    O *get(Handle handle)
+    {
+        if (handle.slot >= generations.size() || generations[handle.slot] != handle.generation)
+            return nullptr;
+        return &at(handle.slot);
+    }
+
+    size_t size() const { return live.size(); }
+    // heap bytes held by the slabs and bookkeeping:
+    size_t memory_usage() const
+    {
+        return chunks.size() * ChunkSize * sizeof(O) + chunks.capacity() * sizeof(chunks[0]) + (generations.capacity() + live_index.capacity() + free_slots.capacity()) * sizeof(uint32_t) + live.capacity() * sizeof(Base *);
+    }
+
+private:
+    std::vector<std::unique_ptr<O[]>> chunks;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> live_index; // slot -> position in 'live'
+    std::vector<uint32_t> free_slots;
+
+    O &at(uint32_t slot) { return chunks[slot / ChunkSize][slot % ChunkSize]; }
+};
@@ -5,6 +5,7 @@
 #include "gl_errors.hpp"
 #include "data_path.hpp"
 #include "hex_dump.hpp"
+#include "Wire.hpp"
 #include "Mesh.hpp"
 #include "Load.hpp"
 #include "Prefab.hpp"
@@ -19,6 +20,8 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/string_cast.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <random>
 #include <array>
 
@@ -42,6 +45,10 @@ PlayMode::PlayMode(Client &client_) : scene(*prototype_scene), radar(this), clie
     };
     Scene(data_path("prototype.scene"), on_drawable);
     bvh.build(std::move(obstacles));
+    predicted.init();
+
+    // the server won't send anything until it has heard which protocol we speak:
+    Game::send_hello_message(&client.connection);
 
     // create TextEngine and load a font
     // if (!text_engine)
@@ -250,7 +257,10 @@ void PlayMode::execute_network_soundcues(ObjectType type, uint8_t sc, glm::vec3
         if (toPlay(sc, SoundCues::Stop))
         {
             // std::cout << "stop engine" << id << std::endl;
-            sub_moving[id]->set_volume(0.0f);
+            // (the start may have happened before this sub came into range)
+            auto moving = sub_moving.find(id);
+            if (moving != sub_moving.end())
+                moving->second->set_volume(0.0f);
         }
         if (toPlay(sc, SoundCues::Hit))
         {
@@ -265,6 +275,10 @@ void PlayMode::update(float elapsed)
 {
     update_control(elapsed);
     update_connection(elapsed);
+    // (nothing to show until the server has said where we are)
+    if (!local_player)
+        return;
+    update_interpolation(elapsed);
     update_radar(elapsed);
     update_camera(elapsed);
     update_sound(elapsed);
@@ -274,10 +288,12 @@ void PlayMode::update(float elapsed)
 
 void PlayMode::update_control(float elapsed)
 {
-    // queue data for sending to server:
-    controls.send_controls_message(&client.connection);
+    // sample inputs, show what they will do without waiting to hear back...
+    predict_local_player(elapsed);
+    // ...and queue any changes for sending to server:
+    input_sender.send_controls_message(&client.connection);
 
-    if (controls.radar.downs)
+    if (controls.radar.downs && local_player)
     {
         radar.scan_special(local_player, 999);
     }
@@ -309,12 +325,16 @@ void PlayMode::update_connection(float elapsed)
 			std::cout << "[" << c->socket << "] closed (!)" << std::endl;
 			throw std::runtime_error("Lost connection to server!");
 		} else { assert(event == Connection::OnRecv);
-			//std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush(); //DEBUG
+			//std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer.contiguous(0, c->recv_buffer.size()), c->recv_buffer.size()); std::cout.flush(); //DEBUG
 			bool handled_message;
 			try {
 				do {
 					handled_message = false;
+					if (Game::recv_welcome_message(c)) handled_message = true;
 					if (recv_state_message(c)) handled_message = true;
+					if (Game::recv_events_message(c, [this](NetworkObject &cue) {
+						execute_network_soundcues(cue.type, cue.sound_cues, glm::vec3(cue.position, 0), cue.id);
+					})) handled_message = true;
 				} while (handled_message);
 			} catch (std::exception const &e) {
 				std::cerr << "[" << c->socket << "] malformed message from server: " << e.what() << std::endl;
@@ -324,6 +344,20 @@ void PlayMode::update_connection(float elapsed)
 		} }, 0.0);
 }
 
+void PlayMode::update_interpolation(float elapsed)
+{
+    interpolator.advance(elapsed);
+    for (auto &entity : entities)
+    {
+        // (the local player is predicted instead)
+        if (&entity.object == local_player)
+            continue;
+        glm::vec2 position;
+        if (entity.transform && interpolator.sample(entity.object.id, &position))
+            entity.transform->position = glm::vec3(position, 0);
+    }
+}
+
 void PlayMode::update_radar(float elapsed)
 {
     radar_timer -= elapsed;
@@ -337,35 +371,25 @@ void PlayMode::update_radar(float elapsed)
 
 void PlayMode::update_camera(float elapsed)
 {
-    glm::vec2 local_pos = network_drawables[local_player->id]->transform->position;
+    glm::vec2 local_pos = local_player_pos();
     camera->transform->position = glm::vec3(local_pos.x, local_pos.y, camera->transform->position.z);
 }
 
 void PlayMode::update_sound(float elapsed)
 {
-    // go through all the network objects to see which has a sound to play
-
-    for (auto &netObj : network_objects)
-    {
-        if (netObj.sound_cues != 0)
-        {
-            execute_network_soundcues(netObj.type, netObj.sound_cues, glm::vec3(netObj.position, 0), netObj.id);
-            // clear the sound_cues
-            netObj.sound_cues = 0;
-        }
-    }
+    // (sound cues are played as their S2C_Events messages arrive, see update_connection)
     // change the position of submarine moving sound
     for (auto it = sub_moving.begin(); it != sub_moving.end();)
     {
-        uint32_t id = it->first;
         // if id doesn't exist in players, it's removed
-        if (network_drawables.find(id) == network_drawables.end())
+        Entity const *entity = find_entity(it->first);
+        if (!entity || !entity->transform)
         {
             it = sub_moving.erase(it);
         }
         else
         {
-            glm::vec3 pos = network_drawables[id]->transform->position;
+            glm::vec3 pos = entity->transform->position;
             it->second->set_position(pos);
             // std::cout<<"here"<<std::endl;
             it++;
@@ -391,6 +415,13 @@ void PlayMode::draw(glm::uvec2 const &drawable_size)
     // update camera aspect ratio for drawable:
     camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
+    if (!local_player)
+    {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        return;
+    }
+
     glm::vec2 player_pos = local_player_pos();
     float depth = glm::max(0.0f, water_surface_y - player_pos.y);
     float atten = glm::clamp(1.0f - atten_speed * depth, 0.0f, 1.0f);
@@ -452,9 +483,11 @@ void PlayMode::draw(glm::uvec2 const &drawable_size)
     {
         if (!data.second.light_on)
             continue;
-        auto player = get_object(data.first);
+        NetworkObject const *player = get_object(data.first);
+        if (!player)
+            continue;
 
-        glm::vec3 spot_light_pos(player.position.x, player.position.y, 0.0f);
+        glm::vec3 spot_light_pos(player->position.x, player->position.y, 0.0f);
         glm::vec3 spot_light_energy(5.0f, 5.0f, 5.0f);
 
         // glm::vec3 spot_light_dir(1.0f, 0.0f, 0.0f);
@@ -482,105 +515,173 @@ void PlayMode::draw(glm::uvec2 const &drawable_size)
 
 glm::vec2 PlayMode::local_player_pos()
 {
-    glm::vec3 p = network_drawables[local_player->id]->transform->position;
+    glm::vec3 p = find_entity(local_player->id)->transform->position;
     return {p.x, p.y};
 }
 
 bool PlayMode::recv_state_message(Connection *connection_)
 {
     assert(connection_);
-    auto &connection = *connection_;
-    auto &recv_buffer = connection.recv_buffer;
+    auto &recv_buffer = connection_->recv_buffer;
 
-    if (recv_buffer.size() < 4)
-        return false;
-    if (recv_buffer[0] != uint8_t(Message::S2C_State))
-        return false;
-    uint32_t size = (uint32_t(recv_buffer[3]) << 16) | (uint32_t(recv_buffer[2]) << 8) | uint32_t(recv_buffer[1]);
-    uint32_t at = 0;
-    // expecting complete message:
-    if (recv_buffer.size() < 4 + size)
+    // only start over once a whole message is here:
+    Wire::Frame frame;
+    if (!Wire::peek(recv_buffer, 0, &frame) || frame.type != uint8_t(Message::S2C_State))
         return false;
 
-    // copy bytes from buffer and advance position:
-    auto read = [&](auto *val)
+    state_messages += 1;
+    uint32_t local_id = 0;
+    bool first = true;
+    auto on_object = [&](NetworkObject &received)
     {
-        if (at + sizeof(*val) > size)
-        {
-            throw std::runtime_error("Ran out of bytes reading state message.");
-        }
-        std::memcpy(val, &recv_buffer[4 + at], sizeof(*val));
-        at += sizeof(*val);
+        // the connection's own player comes first:
+        if (first)
+        {
+            local_id = received.id;
+            first = false;
+        }
+        if (received.deleted)
+        {
+            remove_entity(received.id);
+            return;
+        }
+        auto f = entity_index.find(received.id);
+        if (f == entity_index.end())
+        {
+            f = entity_index.emplace(received.id, uint32_t(entities.size())).first;
+            Entity &entity = entities.emplace_back();
+            entity.object.id = received.id;
+            entity.drawable = create_drawable_at(scene, received.type, glm::vec3(received.position, 0), glm::vec3(received.scale, 1));
+            if (Scene::Drawable *drawable = scene.drawables.get(entity.drawable))
+                entity.transform = drawable->transform;
+        }
+        Entity &entity = entities[f->second];
+        entity.object.type = received.type;
+        entity.object.position = received.position;
+        entity.object.velocity = received.velocity;
+        entity.object.scale = received.scale;
+        entity.seen = state_messages;
+        // (its position follows the interpolator, see update_interpolation)
+        if (entity.transform)
+            entity.transform->scale = glm::vec3(received.scale, 1);
+    };
+    auto on_player_data = [&](uint32_t player_id, Player::PlayerData &data)
+    {
+        player_data[player_id] = data;
     };
 
-    network_objects.clear();
-    uint8_t network_objects_count;
-    read(&network_objects_count);
-    for (uint8_t i = 0; i < network_objects_count; ++i)
+    bool received = Game::recv_state_message(connection_, on_object, on_player_data, level_data, snapshot_history);
+    assert(received);
+
+    // drop anything that went out of the message without a delete:
+    for (size_t i = 0; i < entities.size();)
     {
+        if (entities[i].seen == state_messages)
+            ++i;
+        else
+            remove_entity(entities[i].object.id);
+    }
 
-        network_objects.emplace_back();
-        NetworkObject &obj = network_objects.back();
-        if (obj.sound_cues != 0)
-        {
-            std::cout << "what the fuck" << std::endl;
-        };
-        obj.receive(&at, recv_buffer);
-        // find local player
-        if (i == 0)
-        {
-            local_player = &obj;
-        }
-        // find drawable
-        auto drawable = network_drawables.find(obj.id);
-        // delete if mark deleted
-        if (obj.deleted)
-        {
-            if (drawable != network_drawables.end())
-            {
-                scene.drawables.remove_if([&](const Scene::Drawable &d)
-                                          { return &d == drawable->second; });
-                network_drawables.erase(obj.id);
-            }
-            network_objects.pop_back();
-            continue;
-        }
-        // create drawable if not exit on client
-        if (drawable == network_drawables.end())
-        {
-            network_drawables[obj.id] = create_drawable_at(scene, obj.type, glm::vec3(obj.position, 0), glm::vec3(obj.scale, 1));
-        }
-        // update drawable position
+    // entities may have moved, so point every leaf at its object again:
+    for (auto &entity : entities)
+    {
+        if (entity.proxy == DynamicBVH::Null)
+            entity.proxy = dynamic_bvh.insert(&entity.object);
         else
-        {
-            // std::cout << "update torpedo\n";
-            drawable->second->transform->position = glm::vec3(obj.position, 0);
-            drawable->second->transform->scale = glm::vec3(obj.scale, 1);
-        }
+            dynamic_bvh.update(entity.proxy, &entity.object);
     }
-    // receive player data
-    uint8_t player_data_count;
-    read(&player_data_count);
-    for (uint8_t i = 0; i < player_data_count; ++i)
+    Entity *local = find_entity(local_id);
+    local_player = local ? &local->object : nullptr;
+
+    interpolator.begin(snapshot_history.latest);
+    for (auto const &entity : entities)
+        interpolator.record(entity.object.id, entity.object.position, entity.object.velocity);
+
+    reconcile_prediction();
+
+    return received;
+}
+
+void PlayMode::predict_local_player(float elapsed)
+{
+    uint32_t completed = input_sender.update(elapsed, controls);
+    if (!predicting)
+        return;
+
+    // (the newly completed inputs are the newest unacknowledged ones)
+    auto const &inputs = input_sender.unacked;
+    for (size_t i = inputs.size() - std::min<size_t>(completed, inputs.size()); i < inputs.size(); ++i)
     {
-        uint32_t player_id;
-        read(&player_id);
-        Player::PlayerData data;
-        data.receive(&at, recv_buffer);
-        player_data[player_id] = data;
+        predicted.controls = inputs[i];
+        predicted.step_movement(Game::Tick, bvh, dynamic_bvh);
+        predicted_from = predicted.position;
+        predicted.position = predicted.next_position;
     }
-    // receive level data
-    level_data.receive(&at, recv_buffer);
 
-    if (at != size)
+    prediction_error *= std::exp(-PredictionSmoothing * elapsed);
+    show_prediction();
+}
+
+void PlayMode::reconcile_prediction()
+{
+    // (the local player always comes first, so anything else means the server isn't sending it)
+    if (!local_player || local_player->type != ObjectType::Player)
+        return;
+    Snapshot const *latest = snapshot_history.find(snapshot_history.latest);
+    assert(latest);
+    glm::vec2 shown = predicted_position() + prediction_error;
+
+    // rewind to what the server says...
+    predicted.id = local_player->id;
+    predicted.position = local_player->position;
+    predicted.velocity = local_player->velocity;
+    predicted.scale = local_player->scale;
+    auto data = player_data.find(local_player->id);
+    if (data != player_data.end())
+        predicted.data.player_facing = data->second.player_facing;
+
+    // ...forget the inputs it has already applied...
+    input_sender.acknowledge(latest->input_sequence);
+
+    // ...and replay the rest:
+    predicted_from = predicted.position;
+    for (auto const &input : input_sender.unacked)
+    {
+        predicted.controls = input;
+        predicted.step_movement(Game::Tick, bvh, dynamic_bvh);
+        predicted_from = predicted.position;
+        predicted.position = predicted.next_position;
+    }
+
+    if (!predicting)
+    {
+        predicting = true;
+        prediction_error = glm::vec2(0.0f);
+    }
+    else
     {
-        throw std::runtime_error("Trailing data in state message.");
+        prediction_error = shown - predicted_position();
+        if (glm::length(prediction_error) > PredictionSnap)
+            prediction_error = glm::vec2(0.0f);
     }
+    show_prediction();
+}
 
-    // delete message from buffer:
-    recv_buffer.erase(recv_buffer.begin(), recv_buffer.begin() + 4 + size);
+void PlayMode::show_prediction()
+{
+    if (!predicting || !local_player)
+        return;
+    glm::vec2 shown = predicted_position() + prediction_error;
+    local_player->position = shown;
+    local_player->velocity = predicted.velocity;
+    // (the camera, radar, and spotlight all follow the drawable)
+    find_entity(local_player->id)->transform->position = glm::vec3(shown, 0);
+}
 
-    return true;
+glm::vec2 PlayMode::predicted_position() const
+{
+    float t = std::min(input_sender.accumulator / Game::Tick, 1.0f);
+    return glm::mix(predicted_from, predicted.position, t);
 }
 
 glm::vec2 PlayMode::world_to_screen(glm::vec2 worldPos, const UIRenderer *renderer) const
@@ -611,29 +712,43 @@ UIOverlay &PlayMode::get_overlay(int id)
     return text_overlays[id];
 }
 
-std::vector<NetworkObject> PlayMode::get_objects(ObjectType type) const
+PlayMode::Entity *PlayMode::find_entity(uint32_t id)
 {
-    std::vector<NetworkObject> ret;
-    ret.clear();
-    for (auto &obj : network_objects)
-    {
-        if (obj.type == type)
-        {
-            ret.push_back(obj);
-        }
-    }
-    return ret;
+    auto f = entity_index.find(id);
+    return f == entity_index.end() ? nullptr : &entities[f->second];
 }
 
-NetworkObject PlayMode::get_object(uint32_t id) const
+PlayMode::Entity const *PlayMode::find_entity(uint32_t id) const
 {
-    NetworkObject o;
-    for (auto &obj : network_objects)
+    auto f = entity_index.find(id);
+    return f == entity_index.end() ? nullptr : &entities[f->second];
+}
+
+void PlayMode::remove_entity(uint32_t id)
+{
+    auto f = entity_index.find(id);
+    if (f == entity_index.end())
+        return;
+    uint32_t index = f->second;
+    entity_index.erase(f);
+
+    Entity &entity = entities[index];
+    if (entity.proxy != DynamicBVH::Null)
+        dynamic_bvh.remove(entity.proxy);
+    scene.remove_drawable(entity.drawable);
+    interpolator.forget(id);
+
+    // fill the hole with the last entity (its leaf is re-pointed at the end of recv_state_message):
+    if (index + 1 != entities.size())
     {
-        if (obj.id == id)
-        {
-            return obj;
-        }
+        entities[index] = std::move(entities.back());
+        entity_index[entities[index].object.id] = index;
     }
-    return o;
+    entities.pop_back();
+}
+
+NetworkObject const *PlayMode::get_object(uint32_t id) const
+{
+    Entity const *entity = find_entity(id);
+    return entity ? &entity->object : nullptr;
 }
@@ -13,6 +13,9 @@
 #include "TextEngine.hpp"
 #include "UIRenderer.hpp"
 #include "Level.hpp"
+#include "Snapshot.hpp"
+#include "Interpolator.hpp"
+#include "Input.hpp"
 
 #include <glm/glm.hpp>
 
@@ -38,6 +41,7 @@ struct PlayMode : Mode
     virtual void update(float elapsed) override;
     void update_control(float elapsed);
     void update_connection(float elapsed);
+    void update_interpolation(float elapsed);
     void update_radar(float elapsed);
     void update_camera(float elapsed);
     void update_sound(float elapsed);
@@ -49,9 +53,26 @@ struct PlayMode : Mode
     UIOverlay &get_overlay(int id);
     //----- client game state -----
     Scene::Camera *camera = nullptr;
-    std::unordered_map<uint32_t, Scene::Drawable *> network_drawables;
     Scene scene;
 
+    // everything the server has told us about, updated in place by each state message:
+    //   entities are stored densely and indexed by id; removing one moves the last into its place,
+    //   so pointers into 'entities' (including local_player) only last until the next state message.
+    struct Entity
+    {
+        NetworkObject object;
+        Scene::DrawableHandle drawable;          // removed along with the entity
+        Scene::Transform *transform = nullptr;   // the drawable's (null if this type isn't drawn)
+        uint32_t proxy = DynamicBVH::Null; // leaf in dynamic_bvh
+        uint32_t seen = 0;                 // the last state_messages count that included it
+    };
+    std::vector<Entity> entities;
+    std::unordered_map<uint32_t, uint32_t> entity_index; // object id -> index in entities
+    uint32_t state_messages = 0;
+    Entity *find_entity(uint32_t id);
+    Entity const *find_entity(uint32_t id) const;
+    void remove_entity(uint32_t id);
+
     // sounds
 
     std::unordered_map<uint32_t, std::shared_ptr<Sound::PlayingSample>> sub_moving;
@@ -72,13 +93,13 @@ struct PlayMode : Mode
     // client side function to play sound based on sound_cues
     void execute_network_soundcues(ObjectType type, uint8_t sc, glm::vec3 pos, uint32_t id);
 
-    NetworkObject *local_player;
+    NetworkObject *local_player = nullptr; // in 'entities'; null until the first state message
     // std::list<GameObject> local_obstacles;
     BVH bvh;
+    DynamicBVH dynamic_bvh; // entities, refit on every state message
 
     std::unique_ptr<TextEngine> text_engine = nullptr;
     std::vector<UIOverlay> text_overlays;
-    std::list<NetworkObject> network_objects;
 
     // data for radar
     Radar radar;
@@ -87,8 +108,32 @@ struct PlayMode : Mode
     // data for level
     Level level_data;
 
+    // recent snapshots from the server, which later state messages are diffs against:
+    SnapshotHistory snapshot_history;
+
+    // where to draw everything but the local player, a little behind the newest state message:
+    Interpolator interpolator;
+
     // input tracking for local player:
     Player::Controls controls;
+    // ...sampled into one input per tick, which go to the server when they change:
+    InputSender input_sender;
+
+    // client-side prediction of the local sub:
+    //   'predicted' runs Player::step_movement on each input as it is completed, one Game::Tick at a time like the server,
+    //   against the same trees; every state message resets it to the server's state and replays the inputs still in flight.
+    //   It is drawn between its last two positions, by how far into the next tick the client is.
+    Player predicted;
+    glm::vec2 predicted_from = glm::vec2(0.0f); // position before the newest step
+    bool predicting = false; // set by the first state message
+    // how far reconciliation moved the prediction, shown decaying away rather than as a jump:
+    glm::vec2 prediction_error = glm::vec2(0.0f);
+    static constexpr float PredictionSmoothing = 10.0f; // per second
+    static constexpr float PredictionSnap = 4.0f;       // errors bigger than this (e.g., respawns) jump right away
+    void predict_local_player(float elapsed);
+    void reconcile_prediction();
+    void show_prediction();
+    glm::vec2 predicted_position() const; // between predicted_from and predicted.position
 
     // data for local player;
     std::unordered_map<uint32_t, Player::PlayerData> player_data;
@@ -114,8 +159,8 @@ struct PlayMode : Mode
     //  (return true if data was read)
     bool recv_state_message(Connection *connection);
 
-    std::vector<NetworkObject> get_objects(ObjectType type) const;
-    NetworkObject get_object(uint32_t id) const;
+    // null if the server hasn't sent it (or it's gone):
+    NetworkObject const *get_object(uint32_t id) const;
     Player::PlayerData local_player_data() const
     {
         return player_data.at(local_player->id);
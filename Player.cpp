@@ -31,6 +31,11 @@ int Player::can_collide(const NetworkObject *other) const
     return 0;
 }
 
+bool Player::can_collide_with(ObjectType type) const
+{
+    return type == ObjectType::Player || type == ObjectType::Flag;
+}
+
 void Player::update(float elapsed, Game *game)
 {
 
@@ -41,37 +46,25 @@ void Player::update(float elapsed, Game *game)
     // reset 'downs' since controls have been handled:
 }
 
-void Player::update_movement(float elapsed, Game *game)
+glm::vec2 Player::Controls::direction() const
 {
     glm::vec2 control = glm::vec2(0.0f, 0.0f);
-    if (controls.left.pressed)
+    if (left.pressed)
         control.x -= 1.0f;
-    if (controls.right.pressed)
+    if (right.pressed)
         control.x += 1.0f;
-    if (controls.down.pressed)
+    if (down.pressed)
         control.y -= 1.0f;
-    if (controls.up.pressed)
+    if (up.pressed)
         control.y += 1.0f;
+    return control;
+}
 
-    glm::vec2 v_desired = normalize(control) * MAX_SPEED;
+std::vector<GameObject *> Player::step_movement(float elapsed, BVH &statics, DynamicBVH const &dynamics)
+{
+    glm::vec2 v_desired = normalize(controls.direction()) * MAX_SPEED;
     glm::vec2 dv = v_desired - velocity;
-    float rate = 0;
-    if (glm::dot(dv, v_desired) > 0.0f)
-    {
-        if (glm::length(control) >= 0.01f && !data.engineStarted) // and not playing engine start
-        {
-            data.engineStarted = true;
-            // PLAY SOUND : engine start
-            // PLAY SOUND : engine noise loop
-            add_sound_cue(static_cast<uint8_t>(SoundCues::Start));
-        }
-
-        rate = ACCEL_RATE;
-    }
-    else
-    {
-        rate = DECEL_RATE;
-    }
+    float rate = (glm::dot(dv, v_desired) > 0.0f) ? ACCEL_RATE : DECEL_RATE;
     // lerp velocity
     float dv_len = glm::length(dv);
     if (dv_len > 1e-6f)
@@ -96,6 +89,24 @@ void Player::update_movement(float elapsed, Game *game)
     if (delta.x < -1e-6f)
         data.player_facing = false;
 
+    auto hits = move_with_collision(statics, dynamics, delta);
+    // obstacles stop the sub dead:
+    if (get_colliders(hits, ObjectType::Obstacle))
+        velocity = glm::vec2(0, 0);
+    return hits;
+}
+
+void Player::update_movement(float elapsed, Game *game)
+{
+    glm::vec2 control = controls.direction();
+    glm::vec2 v_desired = normalize(control) * MAX_SPEED;
+    if (glm::length(control) >= 0.01f && !data.engineStarted && glm::dot(v_desired - velocity, v_desired) > 0.0f) // and not playing engine start
+    {
+        data.engineStarted = true;
+        // PLAY SOUND : engine start
+        // PLAY SOUND : engine noise loop
+        add_sound_cue(static_cast<uint8_t>(SoundCues::Start));
+    }
     if (glm::length(control) <= 0.01f && data.engineStarted) // and not playing engine stop
     {
         data.engineStarted = false;
@@ -104,7 +115,7 @@ void Player::update_movement(float elapsed, Game *game)
         add_sound_cue(static_cast<uint8_t>(SoundCues::Stop));
     }
 
-    auto hits = move_with_collision(game, delta);
+    auto hits = step_movement(elapsed, *game->bvh, game->dynamic_bvh);
 
     if (hits.size() > 0)
     {
@@ -112,16 +123,22 @@ void Player::update_movement(float elapsed, Game *game)
         auto flag = get_colliders<Flag>(hits);
         if (flag && !data.has_flag)
         {
-            data.has_flag = true;
-            flag->deleted = true;
-            // UI NOTIFY : flag captured by player
+            defer([this, flag](Game *game)
+                  {
+                // two subs can reach the same flag in one tick, the first in id order gets it:
+                if (flag->deleted || data.has_flag)
+                    return;
+                data.has_flag = true;
+                flag->deleted = true;
+                // UI NOTIFY : flag captured by player
+            });
         }
-        // if hit obstacle
+        // if hit obstacle (step_movement already stopped the sub)
         auto obstacle = get_colliders(hits, ObjectType::Obstacle);
         if (obstacle)
         {
-            take_damage(game, data.collision_damage, obstacle);
-            velocity = glm::vec2(0, 0);
+            defer([this, obstacle](Game *game)
+                  { take_damage(game, data.collision_damage, obstacle); });
         }
     }
 }
@@ -133,11 +150,14 @@ void Player::update_weapon(float elapsed, Game *game)
     {
         // std::cout << "from player: " << id << "wait time is " << data.torpedo_timer << std::endl;
         // std::cout << "Player Pos: " << p.position.x << " " << p.position.y << " \n";
-        Torpedo *torp = game->spawn_object<Torpedo>();
-        torp->position = position;
-
-        torp->velocity = glm::vec2(data.player_facing ? 1 : -1, 0) * Torpedo::TORPEDO_SPEED;
-        torp->owner = id;
+        glm::vec2 at = position;
+        glm::vec2 torp_velocity = glm::vec2(data.player_facing ? 1 : -1, 0) * Torpedo::TORPEDO_SPEED;
+        defer([this, at, torp_velocity](Game *game)
+              {
+            Torpedo *torp = game->spawn_object<Torpedo>();
+            torp->position = at;
+            torp->velocity = torp_velocity;
+            torp->owner = id; });
         data.torpedo_timer = 0.0f;
     }
     else
@@ -152,7 +172,8 @@ void Player::update_control(float elapsed, Game *game)
     {
         if (data.super_radar_exposure)
         {
-            game->level.revealed_objects.emplace_back(id, 0, SUPER_RADAR_EXPOSURE_TIME);
+            defer([this](Game *game)
+                  { game->level.revealed_objects.emplace_back(id, 0, SUPER_RADAR_EXPOSURE_TIME); });
         }
     }
     if (controls.light.downs)
@@ -178,7 +199,8 @@ void Player::update_control(float elapsed, Game *game)
 void Player::update_win_lose(float elapsed, Game *game)
 {
 
-    if (glm::distance(position, data.spawn_pos) < 5)
+    // (next_position is where this sub ends up this tick)
+    if (glm::distance(next_position, data.spawn_pos) < 5)
     {
         // win
         if (data.has_flag)
@@ -223,116 +245,33 @@ void Player::die(Game *game, GameObject *source)
     position = data.spawn_pos;
 }
 
-void Player::Controls::send_controls_message(Connection *connection_) const
-{
-    assert(connection_);
-    auto &connection = *connection_;
-
-    uint32_t size = 13;
-    connection.send(Message::C2S_Controls);
-    connection.send(uint8_t(size));
-    connection.send(uint8_t(size >> 8));
-    connection.send(uint8_t(size >> 16));
-
-    auto send_button = [&](Button const &b)
-    {
-        if (b.downs & 0x80)
-        {
-            std::cerr << "Wow, you are really good at pressing buttons!" << std::endl;
-        }
-        connection.send(uint8_t((b.pressed ? 0x80 : 0x00) | (b.downs & 0x7f)));
-    };
+static_assert(Player::PlayerData::TorpedoTimer.max() >= Player::TORPEDO_COOLDOWN, "torpedo_timer must fit its quantizer");
+static_assert(Player::PlayerData::Health.max() >= Player::MAX_HEALTH, "hp must fit its quantizer");
 
-    send_button(left);
-    send_button(right);
-    send_button(up);
-    send_button(down);
-    send_button(jump);
-    send_button(radar);
-    send_button(light);
-    send_button(num1);
-    send_button(num2);
-    send_button(num3);
-    send_button(num4);
-    send_button(rotate_left);
-    send_button(rotate_right);
-}
-
-bool Player::Controls::recv_controls_message(Connection *connection_)
+void Player::PlayerData::send(BitWriter &writer) const
 {
-    assert(connection_);
-    auto &connection = *connection_;
-
-    auto &recv_buffer = connection.recv_buffer;
-
-    // expecting [type, size_low0, size_mid8, size_high8]:
-    if (recv_buffer.size() < 4)
-        return false;
-    if (recv_buffer[0] != uint8_t(Message::C2S_Controls))
-        return false;
-    uint32_t size = (uint32_t(recv_buffer[3]) << 16) | (uint32_t(recv_buffer[2]) << 8) | uint32_t(recv_buffer[1]);
-    if (size != 13)
-        throw std::runtime_error("Controls message with size " + std::to_string(size) + " != 5!");
-
-    // expecting complete message:
-    if (recv_buffer.size() < 4 + size)
-        return false;
-
-    auto recv_button = [](uint8_t byte, Button *button)
-    {
-        button->pressed = (byte & 0x80);
-        uint32_t d = uint32_t(button->downs) + uint32_t(byte & 0x7f);
-        if (d > 255)
-        {
-            std::cerr << "got a whole lot of downs" << std::endl;
-            d = 255;
-        }
-        button->downs = uint8_t(d);
-    };
-
-    recv_button(recv_buffer[4 + 0], &left);
-    recv_button(recv_buffer[4 + 1], &right);
-    recv_button(recv_buffer[4 + 2], &up);
-    recv_button(recv_buffer[4 + 3], &down);
-    recv_button(recv_buffer[4 + 4], &jump);
-    recv_button(recv_buffer[4 + 5], &radar);
-    recv_button(recv_buffer[4 + 6], &light);
-    recv_button(recv_buffer[4 + 7], &num1);
-    recv_button(recv_buffer[4 + 8], &num2);
-    recv_button(recv_buffer[4 + 9], &num3);
-    recv_button(recv_buffer[4 + 10], &num4);
-    recv_button(recv_buffer[4 + 11], &rotate_left);
-    recv_button(recv_buffer[4 + 12], &rotate_right);
-
-    // delete message from buffer:
-    recv_buffer.erase(recv_buffer.begin(), recv_buffer.begin() + 4 + size);
-
-    return true;
-}
+    writer.write(TorpedoTimer, torpedo_timer);
+    writer.write(player_facing);
+    writer.write(Health, hp);
+    writer.write(has_flag);
+    writer.write_varbits(uint32_t(std::max(flag_count, 0)));
+    writer.write(PositionX, PositionY, spawn_pos);
+    writer.write(light_on);
+};
 
-void Player::PlayerData::send(Connection *connection) const
+bool Player::PlayerData::synced_equals(PlayerData const &other) const
 {
-    connection->send(torpedo_timer);
-    connection->send(player_facing);
-    connection->send(hp);
-    connection->send(has_flag);
-    connection->send(flag_count);
-    connection->send(spawn_pos);
-    connection->send(light_on);
-};
+    // compare what would be on the wire, so changes too small to survive quantization aren't resent:
+    return TorpedoTimer.encode(torpedo_timer) == TorpedoTimer.encode(other.torpedo_timer) && player_facing == other.player_facing && Health.encode(hp) == Health.encode(other.hp) && has_flag == other.has_flag && flag_count == other.flag_count && PositionX.encode(spawn_pos.x) == PositionX.encode(other.spawn_pos.x) && PositionY.encode(spawn_pos.y) == PositionY.encode(other.spawn_pos.y) && light_on == other.light_on;
+}
 
-void Player::PlayerData::receive(uint32_t *at, std::vector<uint8_t> &recv_buffer)
+void Player::PlayerData::receive(BitReader &reader)
 {
-    auto read = [&](auto *val)
-    {
-        std::memcpy(val, &recv_buffer[4 + *at], sizeof(*val));
-        *at += sizeof(*val);
-    };
-    read(&torpedo_timer);
-    read(&player_facing);
-    read(&hp);
-    read(&has_flag);
-    read(&flag_count);
-    read(&spawn_pos);
-    read(&light_on);
+    torpedo_timer = reader.read(TorpedoTimer);
+    player_facing = reader.read_bool();
+    hp = reader.read(Health);
+    has_flag = reader.read_bool();
+    flag_count = int(reader.read_varbits());
+    spawn_pos = reader.read(PositionX, PositionY);
+    light_on = reader.read_bool();
 };
\ No newline at end of file
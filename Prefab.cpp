@@ -24,25 +24,26 @@ Load<Prefab> prefab_torpedo(LoadTagLate, []() -> Prefab const *
 Load<Prefab> prefab_flag(LoadTagLate, []() -> Prefab const *
                          { return new Prefab("Flag"); });
 
-Scene::Drawable *Prefab::create_drawable(Scene &scene, glm::vec3 pos, glm::vec3 scale, glm::quat rotation) const
+Scene::DrawableHandle Prefab::create_drawable(Scene &scene, glm::vec3 pos, glm::vec3 scale, glm::quat rotation) const
 {
     // create transform
-    Scene::Transform &transform = scene.transforms.emplace_back();
-    Scene::Transform *transform_p = &transform;
+    Scene::TransformHandle transform = scene.transforms.emplace();
+    Scene::Transform *transform_p = scene.transforms.get(transform);
     transform_p->position = pos;
     transform_p->scale = scale;
     transform_p->rotation = rotation;
 
-    // create drawables
-    scene.drawables.emplace_back(transform_p);
-    Scene::Drawable &drawable = scene.drawables.back();
+    // create drawables (which take the transform with them when removed)
+    Scene::DrawableHandle handle = scene.drawables.emplace(transform_p);
+    Scene::Drawable &drawable = *scene.drawables.get(handle);
+    drawable.owned_transform = transform;
 
     drawable.pipeline = lit_color_texture_program_pipeline;
     drawable.pipeline.vao = meshes_for_lit_color_texture_program;
     drawable.pipeline.type = mesh.type;
     drawable.pipeline.start = mesh.start;
     drawable.pipeline.count = mesh.count;
-    return &drawable;
+    return handle;
 }
 
 Prefab::Prefab(std::string n) : name(n)
@@ -14,12 +14,13 @@ struct Prefab
     Prefab(std::string n);
     Prefab() {};
 
-    Scene::Drawable *create_drawable(Scene &scene, glm::vec3 pos) const
+    // (remove with Scene::remove_drawable)
+    Scene::DrawableHandle create_drawable(Scene &scene, glm::vec3 pos) const
     {
         return create_drawable(scene, pos, glm::vec3(1, 1, 1), glm::quat(0, 0, 0, 1));
     }
 
-    Scene::Drawable *create_drawable(Scene &scene, glm::vec3 pos, glm::vec3 scale, glm::quat rotation) const;
+    Scene::DrawableHandle create_drawable(Scene &scene, glm::vec3 pos, glm::vec3 scale, glm::quat rotation) const;
 };
 extern Load<MeshBuffer> prototype_prefab_meshes;
 
@@ -27,7 +28,7 @@ extern Load<Prefab> prefab_player;
 extern Load<Prefab> prefab_torpedo;
 extern Load<Prefab> prefab_flag;
 
-static inline Scene::Drawable *create_drawable_at(Scene &scene, ObjectType type, glm::vec3 pos, glm::vec3 scale)
+static inline Scene::DrawableHandle create_drawable_at(Scene &scene, ObjectType type, glm::vec3 pos, glm::vec3 scale)
 {
     switch (type)
     {
@@ -38,6 +39,6 @@ static inline Scene::Drawable *create_drawable_at(Scene &scene, ObjectType type,
     case ObjectType::Flag:
         return prefab_torpedo->create_drawable(scene, pos, scale, glm::quat(0, 0, 0, 1));
     default:
-        return nullptr;
+        return Scene::DrawableHandle();
     }
 }
\ No newline at end of file
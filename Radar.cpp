@@ -77,11 +77,13 @@ void Radar::render_revealed_player()
         auto id = client_game->level_data.revealed_objects[i].obj_id;
         if (id == client_game->local_player->id)
             continue;
-        auto p = client_game->get_object(id);
+        NetworkObject const *p = client_game->get_object(id);
+        if (!p)
+            continue;
         auto renderer = client_game->get_overlay(PlayMode::RADAR).renderer;
         glm::vec2 size = glm::vec2(RADAR_POINT_SIZE, RADAR_POINT_SIZE);
         // std::cout << key << " " << p.position.x << "/" << p.position.y << "\n";
-        glm::vec2 pos = client_game->world_to_screen(glm::vec3(p.position, 0), renderer);
+        glm::vec2 pos = client_game->world_to_screen(glm::vec3(p->position, 0), renderer);
 
         pos.x = std::clamp(pos.x, size.x / 2.0f, (float)renderer->width - size.x / 2.0f);
         pos.y = std::clamp(pos.y, size.y / 2.0f, (float)renderer->height - size.y / 2.0f);
@@ -229,8 +231,9 @@ void Radar::scan_special(GameObject const *origin, float range)
         return idx;
     };
 
-    for (auto &obj : client_game->network_objects)
+    for (auto &entity : client_game->entities)
     {
+        NetworkObject const &obj = entity.object;
         GLuint texture;
         if (obj.type == ObjectType::Player && obj.id != client_game->local_player->id)
         {
@@ -280,16 +283,8 @@ Trace Radar::raycast_direction(const glm::vec2 origin, glm::vec2 direction, floa
     // bvh on all obstacles
     closest = client_game->bvh.hit(ray);
     // additional raycast on dynamic objects
-    for (const auto &o : client_game->network_objects)
-    {
-        if (o.id == client_game->local_player->id)
-            continue;
-        Trace h = o.hit(ray);
-        if (h.hit)
-        {
-            if (h.distance < closest.distance)
-                closest = h;
-        }
-    }
+    Trace h = client_game->dynamic_bvh.hit(ray, client_game->local_player);
+    if (h.hit && h.distance < closest.distance)
+        closest = h;
     return closest;
 }
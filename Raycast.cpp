@@ -2,7 +2,9 @@
 #include "BBox.hpp"
 #include "GameObject.hpp"
 #include <algorithm>
+#include <cassert>
 #include <iostream>
+#include <limits>
 #include <vector>
 
 bool Node::is_leaf() const
@@ -51,7 +53,8 @@ void BVH::build(std::vector<GameObject> &&prims, size_t max_leaf_size)
         }
 
         float c_min = std::numeric_limits<float>::infinity();
-        auto best_split = begin;
+        int best_axis = -1;
+        float best_split_pos = 0.0f;
 
         for (int axis = 0; axis < 2; axis++)
         {
@@ -60,25 +63,34 @@ void BVH::build(std::vector<GameObject> &&prims, size_t max_leaf_size)
                 continue;
             for (int split = 0; split < partitionPerAxis - 1; split++)
             {
-                float left_bucket_size = bucket_size * float(split + 1) / float(partitionPerAxis);
+                float split_pos = bucket_data.bb.min[axis] + bucket_size * float(split + 1) / float(partitionPerAxis);
                 auto split_point = std::partition(begin, end, [&](const GameObject &p)
-                                                  { return p.get_BBox().center()[axis] < left_bucket_size; });
+                                                  { return p.get_BBox().center()[axis] < split_pos; });
 
                 SAHBucketData bucket_left = compute_bbox_all(begin, split_point);
                 SAHBucketData bucket_right = compute_bbox_all(split_point, end);
 
                 if (bucket_left.num_prims == 0 || bucket_right.num_prims == 0)
-                    break;
+                    continue;
 
                 float c = bucket_left.bb.surface_area() * bucket_left.num_prims + bucket_right.bb.surface_area() * bucket_right.num_prims;
                 if (c < c_min)
                 {
                     c_min = c;
-                    best_split = split_point;
+                    best_axis = axis;
+                    best_split_pos = split_pos;
                 }
             }
         }
 
+        // later candidates reordered the range, so partition again by the best split:
+        auto best_split = begin;
+        if (best_axis >= 0)
+        {
+            best_split = std::partition(begin, end, [&](const GameObject &p)
+                                        { return p.get_BBox().center()[best_axis] < best_split_pos; });
+        }
+
         SAHBucketData bucket_left = compute_bbox_all(begin, best_split);
         SAHBucketData bucket_right = compute_bbox_all(best_split, end);
         if (bucket_left.num_prims == 0 || bucket_right.num_prims == 0)
@@ -209,6 +221,77 @@ Trace BVH::hit(const Ray2D &ray) const
     find_closest_hit(find_closest_hit, root_idx, ray.dist_bounds);
     return closest_hit;
 }
+void BVH::query(const BBox &box, std::vector<GameObject *> &out)
+{
+    if (nodes.size() == 0)
+        return;
+
+    auto find_overlaps = [&](auto &&self, size_t n) -> void
+    {
+        const Node &node = nodes[n];
+        if (!node.bbox.overlaps(box))
+            return;
+
+        if (node.is_leaf())
+        {
+            for (size_t i = 0; i < node.size; i++)
+            {
+                GameObject &obstacle = obstacles[node.start + i];
+                if (obstacle.get_BBox().overlaps(box))
+                    out.push_back(&obstacle);
+            }
+            return;
+        }
+        self(self, node.l);
+        self(self, node.r);
+    };
+
+    find_overlaps(find_overlaps, root_idx);
+}
+
+Trace BVH::sweep(const Ray2D &ray, glm::vec2 half_extent) const
+{
+    Trace closest_hit;
+    closest_hit.hit = false;
+    closest_hit.distance = ray.dist_bounds.y;
+
+    if (nodes.size() == 0)
+        return closest_hit;
+
+    auto find_closest_hit = [&](auto &&self, size_t n) -> void
+    {
+        const Node &node = nodes[n];
+        BBox grown{node.bbox.min - half_extent, node.bbox.max + half_extent};
+        glm::vec2 t(ray.dist_bounds.x, closest_hit.distance);
+        if (!grown.hit(ray, t))
+            return;
+
+        if (node.is_leaf())
+        {
+            for (size_t i = 0; i < node.size; i++)
+            {
+                const GameObject &obstacle = obstacles[node.start + i];
+                glm::vec2 times(ray.dist_bounds.x, closest_hit.distance);
+                glm::vec2 normal;
+                if (sweep_box(obstacle.get_BBox(), half_extent, ray, times, normal) && times.x < closest_hit.distance)
+                {
+                    closest_hit.hit = true;
+                    closest_hit.distance = times.x;
+                    closest_hit.point = ray.at(times.x);
+                    closest_hit.normal = normal;
+                    closest_hit.obj = &obstacle;
+                }
+            }
+            return;
+        }
+        self(self, node.l);
+        self(self, node.r);
+    };
+
+    find_closest_hit(find_closest_hit, root_idx);
+    return closest_hit;
+}
+
 size_t BVH::new_node(BBox box, size_t start, size_t size, size_t l, size_t r)
 {
     Node n;
@@ -219,4 +302,364 @@ size_t BVH::new_node(BBox box, size_t start, size_t size, size_t l, size_t r)
     n.r = r;
     nodes.push_back(n);
     return nodes.size() - 1;
-}
\ No newline at end of file
+}
+//------------------------------------------------------
+
+static inline BBox union_box(const BBox &a, const BBox &b)
+{
+    BBox ret = a;
+    ret.enclose(b);
+    return ret;
+}
+
+static inline float perimeter(const BBox &b)
+{
+    glm::vec2 extent = b.max - b.min;
+    return 2.0f * (extent.x + extent.y);
+}
+
+static inline bool contains(const BBox &outer, const BBox &inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y &&
+           inner.max.x <= outer.max.x && inner.max.y <= outer.max.y;
+}
+
+BBox DynamicBVH::fat_box(const GameObject *obj) const
+{
+    BBox box = obj->get_BBox();
+    box.min -= glm::vec2(margin);
+    box.max += glm::vec2(margin);
+    // stretch along the direction of travel:
+    glm::vec2 d = obj->velocity * look_ahead;
+    box.min = BBox::hmin(box.min, box.min + d);
+    box.max = BBox::hmax(box.max, box.max + d);
+    return box;
+}
+
+uint32_t DynamicBVH::allocate_node()
+{
+    uint32_t n;
+    if (free_list != Null)
+    {
+        n = free_list;
+        free_list = nodes[n].parent;
+    }
+    else
+    {
+        n = uint32_t(nodes.size());
+        nodes.emplace_back();
+    }
+    nodes[n] = DynamicNode();
+    return n;
+}
+
+void DynamicBVH::free_node(uint32_t n)
+{
+    nodes[n].height = -1;
+    nodes[n].obj = nullptr;
+    nodes[n].parent = free_list;
+    free_list = n;
+}
+
+uint32_t DynamicBVH::insert(GameObject *obj)
+{
+    uint32_t leaf = allocate_node();
+    nodes[leaf].box = fat_box(obj);
+    nodes[leaf].obj = obj;
+    nodes[leaf].height = 0;
+    insert_leaf(leaf);
+    leaf_count++;
+    return leaf;
+}
+
+void DynamicBVH::remove(uint32_t proxy)
+{
+    assert(proxy < nodes.size() && nodes[proxy].is_leaf());
+    remove_leaf(proxy);
+    free_node(proxy);
+    leaf_count--;
+}
+
+bool DynamicBVH::update(uint32_t proxy, GameObject *obj)
+{
+    assert(proxy < nodes.size() && nodes[proxy].is_leaf());
+    nodes[proxy].obj = obj;
+    if (contains(nodes[proxy].box, obj->get_BBox()))
+        return false;
+
+    remove_leaf(proxy);
+    nodes[proxy].box = fat_box(obj);
+    insert_leaf(proxy);
+    return true;
+}
+
+void DynamicBVH::clear()
+{
+    nodes.clear();
+    root = Null;
+    free_list = Null;
+    leaf_count = 0;
+}
+
+void DynamicBVH::insert_leaf(uint32_t leaf)
+{
+    if (root == Null)
+    {
+        root = leaf;
+        nodes[root].parent = Null;
+        return;
+    }
+
+    // walk down towards the sibling that makes the tree grow the least:
+    BBox leaf_box = nodes[leaf].box;
+    uint32_t index = root;
+    while (!nodes[index].is_leaf())
+    {
+        const DynamicNode &node = nodes[index];
+        float area = perimeter(node.box);
+        float combined_area = perimeter(union_box(node.box, leaf_box));
+
+        // cost of making a new parent for this node and the leaf:
+        float cost = 2.0f * combined_area;
+        // minimum cost of pushing the leaf further down the tree:
+        float inheritance_cost = 2.0f * (combined_area - area);
+
+        auto descend_cost = [&](uint32_t child)
+        {
+            const DynamicNode &c = nodes[child];
+            float new_area = perimeter(union_box(leaf_box, c.box));
+            if (c.is_leaf())
+                return new_area + inheritance_cost;
+            return new_area - perimeter(c.box) + inheritance_cost;
+        };
+        float cost1 = descend_cost(node.child1);
+        float cost2 = descend_cost(node.child2);
+
+        if (cost < cost1 && cost < cost2)
+            break;
+        index = (cost1 < cost2) ? node.child1 : node.child2;
+    }
+
+    uint32_t sibling = index;
+    uint32_t old_parent = nodes[sibling].parent;
+    uint32_t new_parent = allocate_node();
+    nodes[new_parent].parent = old_parent;
+    nodes[new_parent].box = union_box(leaf_box, nodes[sibling].box);
+    nodes[new_parent].height = nodes[sibling].height + 1;
+    nodes[new_parent].child1 = sibling;
+    nodes[new_parent].child2 = leaf;
+    nodes[sibling].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+
+    if (old_parent != Null)
+    {
+        if (nodes[old_parent].child1 == sibling)
+            nodes[old_parent].child1 = new_parent;
+        else
+            nodes[old_parent].child2 = new_parent;
+    }
+    else
+    {
+        root = new_parent;
+    }
+
+    refit_ancestors(nodes[leaf].parent);
+}
+
+void DynamicBVH::remove_leaf(uint32_t leaf)
+{
+    if (leaf == root)
+    {
+        root = Null;
+        return;
+    }
+
+    uint32_t parent = nodes[leaf].parent;
+    uint32_t grand_parent = nodes[parent].parent;
+    uint32_t sibling = (nodes[parent].child1 == leaf) ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grand_parent != Null)
+    {
+        // destroy parent and connect sibling to grand_parent:
+        if (nodes[grand_parent].child1 == parent)
+            nodes[grand_parent].child1 = sibling;
+        else
+            nodes[grand_parent].child2 = sibling;
+        nodes[sibling].parent = grand_parent;
+        free_node(parent);
+        refit_ancestors(grand_parent);
+    }
+    else
+    {
+        root = sibling;
+        nodes[sibling].parent = Null;
+        free_node(parent);
+    }
+}
+
+void DynamicBVH::refit_ancestors(uint32_t index)
+{
+    while (index != Null)
+    {
+        index = balance(index);
+
+        DynamicNode &node = nodes[index];
+        const DynamicNode &child1 = nodes[node.child1];
+        const DynamicNode &child2 = nodes[node.child2];
+        node.height = 1 + std::max(child1.height, child2.height);
+        node.box = union_box(child1.box, child2.box);
+
+        index = node.parent;
+    }
+}
+
+// rotate 'a' with its taller child if the children's heights differ by more than one
+// returns the index of the node now at a's old position
+uint32_t DynamicBVH::balance(uint32_t ia)
+{
+    DynamicNode &a = nodes[ia];
+    if (a.is_leaf() || a.height < 2)
+        return ia;
+
+    uint32_t ib = a.child1;
+    uint32_t ic = a.child2;
+    DynamicNode &b = nodes[ib];
+    DynamicNode &c = nodes[ic];
+
+    // moves child 'up' into a's place; 'up' keeps its taller child and hands the shorter one to a
+    // ('other' is a's remaining child, 'up_was_child1' says which slot 'up' came from)
+    auto rotate = [&](uint32_t iup, DynamicNode &up, DynamicNode &other, bool up_was_child1)
+    {
+        uint32_t i1 = up.child1;
+        uint32_t i2 = up.child2;
+        DynamicNode &n1 = nodes[i1];
+        DynamicNode &n2 = nodes[i2];
+
+        up.child1 = ia;
+        up.parent = a.parent;
+        a.parent = iup;
+
+        if (up.parent != Null)
+        {
+            if (nodes[up.parent].child1 == ia)
+                nodes[up.parent].child1 = iup;
+            else
+                nodes[up.parent].child2 = iup;
+        }
+        else
+        {
+            root = iup;
+        }
+
+        uint32_t keep = (n1.height > n2.height) ? i1 : i2;
+        uint32_t give = (keep == i1) ? i2 : i1;
+        up.child2 = keep;
+        if (up_was_child1)
+            a.child1 = give;
+        else
+            a.child2 = give;
+        nodes[give].parent = ia;
+
+        a.box = union_box(other.box, nodes[give].box);
+        a.height = 1 + std::max(other.height, nodes[give].height);
+        up.box = union_box(a.box, nodes[keep].box);
+        up.height = 1 + std::max(a.height, nodes[keep].height);
+    };
+
+    int balance = c.height - b.height;
+    if (balance > 1)
+    {
+        rotate(ic, c, b, false);
+        return ic;
+    }
+    if (balance < -1)
+    {
+        rotate(ib, b, c, true);
+        return ib;
+    }
+    return ia;
+}
+
+Trace DynamicBVH::hit(const Ray2D &ray, const GameObject *ignore) const
+{
+    Trace closest_hit;
+    closest_hit.hit = false;
+    closest_hit.distance = ray.dist_bounds.y;
+
+    if (root == Null)
+        return closest_hit;
+
+    auto find_closest_hit = [&](auto &&self, uint32_t n) -> void
+    {
+        const DynamicNode &node = nodes[n];
+        glm::vec2 t(ray.dist_bounds.x, closest_hit.distance);
+        if (!node.box.hit(ray, t))
+            return;
+
+        if (node.is_leaf())
+        {
+            if (node.obj == ignore)
+                return;
+            Trace trace = node.obj->hit(ray);
+            if (trace.hit && trace.distance < closest_hit.distance)
+                closest_hit = trace;
+            return;
+        }
+
+        // visit the nearer child first so the far one can often be skipped:
+        glm::vec2 t1(ray.dist_bounds.x, closest_hit.distance);
+        glm::vec2 t2 = t1;
+        bool hit1 = nodes[node.child1].box.hit(ray, t1);
+        bool hit2 = nodes[node.child2].box.hit(ray, t2);
+        uint32_t first = node.child1;
+        uint32_t second = node.child2;
+        if (hit1 && hit2 && t2.x < t1.x)
+            std::swap(first, second);
+        if (hit1 || hit2)
+        {
+            self(self, first);
+            self(self, second);
+        }
+    };
+
+    find_closest_hit(find_closest_hit, root);
+    return closest_hit;
+}
+
+bool DynamicBVH::sweep_leaf(uint32_t leaf, const Ray2D &ray, glm::vec2 half_extent, Trace &closest_hit) const
+{
+    const GameObject *obj = nodes[leaf].obj;
+    glm::vec2 times(ray.dist_bounds.x, closest_hit.distance);
+    glm::vec2 normal;
+    if (!sweep_box(obj->get_BBox(), half_extent, ray, times, normal) || times.x >= closest_hit.distance)
+        return false;
+    closest_hit.hit = true;
+    closest_hit.distance = times.x;
+    closest_hit.point = ray.at(times.x);
+    closest_hit.normal = normal;
+    closest_hit.obj = obj;
+    return true;
+}
+
+//------------------------------------------------------
+
+bool sweep_box(const BBox &target, glm::vec2 half_extent, const Ray2D &ray, glm::vec2 &times, glm::vec2 &normal)
+{
+    BBox grown{target.min - half_extent, target.max + half_extent};
+    if (!grown.hit(ray, times))
+        return false;
+
+    // the face that was hit is on the axis whose slab the ray entered last:
+    float entry[2];
+    for (int axis = 0; axis < 2; axis++)
+    {
+        if (std::abs(ray.dir[axis]) < 1e-8f)
+            entry[axis] = -std::numeric_limits<float>::infinity();
+        else
+            entry[axis] = ((ray.dir[axis] > 0.0f ? grown.min[axis] : grown.max[axis]) - ray.point[axis]) / ray.dir[axis];
+    }
+    int axis = (entry[0] > entry[1]) ? 0 : 1;
+    normal = glm::vec2(0.0f);
+    normal[axis] = (ray.dir[axis] > 0.0f) ? -1.0f : 1.0f;
+    return true;
+}
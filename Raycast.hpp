@@ -4,6 +4,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <algorithm>
+#include <cstdint>
 #include <vector>
 
 struct GameObject;
@@ -35,10 +36,94 @@ struct BVH
 
     void build(std::vector<GameObject> &&obstacles, size_t max_leaf_size = 1);
     Trace hit(const Ray2D &ray) const;
+    // append every obstacle whose box overlaps 'box' to 'out'
+    void query(const BBox &box, std::vector<GameObject *> &out);
+    // earliest obstacle hit by a box with the given half extent moving along 'ray'
+    Trace sweep(const Ray2D &ray, glm::vec2 half_extent) const;
 
     size_t new_node(BBox box, size_t start, size_t size, size_t l, size_t r);
 };
 
+/**
+ * Incrementally updated AABB tree for objects that move (players, torpedoes, flags).
+ * Leaves store a "fat" box: the object's box grown by 'margin' and stretched along its
+ * velocity by 'look_ahead' seconds, so small moves only need update() to check
+ * containment instead of restructuring. Insertion picks the cheapest sibling by
+ * perimeter and the tree is kept balanced with AVL-style rotations.
+ * (based on Box2D's b2DynamicTree)
+ */
+struct DynamicBVH
+{
+    static constexpr uint32_t Null = 0xFFFFFFFFu;
+
+    float margin = 0.1f;
+    float look_ahead = 0.15f;
+
+    // returns the proxy id for obj
+    uint32_t insert(GameObject *obj);
+    void remove(uint32_t proxy);
+    // re-fit the proxy after obj moved (obj may also be a new address for the same object)
+    // returns true if the leaf had to be re-inserted
+    bool update(uint32_t proxy, GameObject *obj);
+    void clear();
+
+    // calls f(GameObject *) for every leaf whose fat box overlaps 'box'; callers re-test the exact box
+    template <typename F>
+    void query(const BBox &box, F &&f) const
+    {
+        if (root == Null)
+            return;
+        auto find_overlaps = [&](auto &&self, uint32_t n) -> void
+        {
+            const DynamicNode &node = nodes[n];
+            if (!node.box.overlaps(box))
+                return;
+            if (node.is_leaf())
+            {
+                f(node.obj);
+                return;
+            }
+            self(self, node.child1);
+            self(self, node.child2);
+        };
+        find_overlaps(find_overlaps, root);
+    }
+
+    Trace hit(const Ray2D &ray, const GameObject *ignore = nullptr) const;
+    // earliest leaf hit by a box with the given half extent moving along 'ray',
+    // skipping any object for which accept(const GameObject *) returns false
+    template <typename F>
+    Trace sweep(const Ray2D &ray, glm::vec2 half_extent, F &&accept) const;
+
+    size_t size() const { return leaf_count; }
+    size_t memory_usage() const { return nodes.capacity() * sizeof(DynamicNode); }
+
+private:
+    struct DynamicNode
+    {
+        BBox box;
+        GameObject *obj = nullptr;
+        uint32_t parent = Null; // next free node while on the free list
+        uint32_t child1 = Null, child2 = Null;
+        int height = 0; // leaf = 0, free = -1
+
+        bool is_leaf() const { return child1 == Null; }
+    };
+    std::vector<DynamicNode> nodes;
+    uint32_t root = Null;
+    uint32_t free_list = Null;
+    size_t leaf_count = 0;
+
+    uint32_t allocate_node();
+    void free_node(uint32_t n);
+    void insert_leaf(uint32_t leaf);
+    void remove_leaf(uint32_t leaf);
+    uint32_t balance(uint32_t a);
+    void refit_ancestors(uint32_t n);
+    BBox fat_box(const GameObject *obj) const;
+    bool sweep_leaf(uint32_t leaf, const Ray2D &ray, glm::vec2 half_extent, Trace &closest_hit) const;
+};
+
 struct SAHBucketData
 {
     BBox bb;          ///< bbox of all primitives
@@ -76,6 +161,45 @@ struct Ray2D
     glm::vec2 dist_bounds = glm::vec2(0.0f, std::numeric_limits<float>::infinity());
 };
 
+/**
+ * Swept box test: does a box with the given half extent, centered on ray.point, hit 'target'
+ * while moving along the ray within 'times'? (the ray against 'target' grown by half_extent)
+ * On a hit, times.x is the time of impact and 'normal' is the face of 'target' that was hit.
+ */
+bool sweep_box(const BBox &target, glm::vec2 half_extent, const Ray2D &ray, glm::vec2 &times, glm::vec2 &normal);
+
+template <typename F>
+Trace DynamicBVH::sweep(const Ray2D &ray, glm::vec2 half_extent, F &&accept) const
+{
+    Trace closest_hit;
+    closest_hit.hit = false;
+    closest_hit.distance = ray.dist_bounds.y;
+
+    if (root == Null)
+        return closest_hit;
+
+    auto find_closest_hit = [&](auto &&self, uint32_t n) -> void
+    {
+        const DynamicNode &node = nodes[n];
+        BBox grown{node.box.min - half_extent, node.box.max + half_extent};
+        glm::vec2 t(ray.dist_bounds.x, closest_hit.distance);
+        if (!grown.hit(ray, t))
+            return;
+
+        if (node.is_leaf())
+        {
+            if (accept(static_cast<const GameObject *>(node.obj)))
+                sweep_leaf(n, ray, half_extent, closest_hit);
+            return;
+        }
+        self(self, node.child1);
+        self(self, node.child2);
+    };
+
+    find_closest_hit(find_closest_hit, root);
+    return closest_hit;
+}
+
 // assume dir is normalized
 // static inline bool raycastBBox(const glm::vec2 &origin, const glm::vec2 &dir, const GameObject &box, float range, RaycastResult &out)
 // {
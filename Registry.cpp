@@ -65,8 +65,7 @@ Load<Scene> prototype_scene(LoadTagDefault, []() -> Scene const *
         if (mesh_name == "Player") return;
         if (mesh_name == "Torpedo") return;
         Mesh const &mesh = prototype_scene_meshes->lookup(mesh_name);
-        scene.drawables.emplace_back(transform);
-        Scene::Drawable &drawable = scene.drawables.back();
+        Scene::Drawable &drawable = scene.drawables.emplace_back(transform);
 
         drawable.pipeline = lit_color_texture_program_pipeline;
         drawable.pipeline.vao = meshes_for_lit_color_texture_program;
@@ -266,8 +266,7 @@ void Scene::load(std::string const &filename,
 
     for (auto const &h : hierarchy)
     {
-        transforms.emplace_back();
-        Transform *t = &transforms.back();
+        Transform *t = &transforms.emplace_back();
         if (h.parent != -1U)
         {
             if (h.parent >= hierarchy_transforms.size())
@@ -403,19 +402,24 @@ void Scene::set(Scene const &other, std::unordered_map<Transform const *, Transf
     transform_to_transform.insert(std::make_pair(nullptr, nullptr));
 
     // Copy transforms and store mapping:
+    //  (drawables are cleared too, since they point at the transforms being replaced)
+    drawables.clear();
     transforms.clear();
+    std::unordered_map<Transform const *, TransformHandle> transform_handles;
     for (auto const &t : other.transforms)
     {
-        transforms.emplace_back();
-        transforms.back().name = t.name;
-        transforms.back().position = t.position;
-        transforms.back().rotation = t.rotation;
-        transforms.back().scale = t.scale;
-        transforms.back().parent = t.parent; // will update later
+        TransformHandle handle = transforms.emplace();
+        Transform &copy = *transforms.get(handle);
+        copy.name = t.name;
+        copy.position = t.position;
+        copy.rotation = t.rotation;
+        copy.scale = t.scale;
+        copy.parent = t.parent; // will update later
 
         // store mapping between transforms old and new:
-        auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
+        auto ret = transform_to_transform.insert(std::make_pair(&t, &copy));
         assert(ret.second);
+        transform_handles.emplace(&t, handle);
     }
 
     // update transform parents:
@@ -425,10 +429,12 @@ void Scene::set(Scene const &other, std::unordered_map<Transform const *, Transf
     }
 
     // copy other's drawables, updating transform pointers:
-    drawables = other.drawables;
-    for (auto &d : drawables)
+    for (auto const &d : other.drawables)
     {
-        d.transform = transform_to_transform.at(d.transform);
+        Drawable &copy = drawables.emplace_back(d);
+        copy.transform = transform_to_transform.at(d.transform);
+        Transform const *owned = other.transforms.get(d.owned_transform);
+        copy.owned_transform = owned ? transform_handles.at(owned) : TransformHandle();
     }
 
     // copy other's cameras, updating transform pointers:
@@ -445,3 +451,12 @@ void Scene::set(Scene const &other, std::unordered_map<Transform const *, Transf
         l.transform = transform_to_transform.at(l.transform);
     }
 }
+
+void Scene::remove_drawable(DrawableHandle handle)
+{
+    Drawable *drawable = drawables.get(handle);
+    if (!drawable)
+        return;
+    transforms.erase(drawable->owned_transform);
+    drawables.erase(handle);
+}
@@ -12,6 +12,7 @@
 
 #include "GL.hpp"
 #include "GameObject.hpp"
+#include "SlotMap.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -57,6 +58,8 @@ struct Scene
         // a 'Drawable' attaches attribute data to a transform:
         Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
         Transform *transform;
+        // a transform made just for this drawable (e.g., by Prefab), which remove_drawable also removes:
+        SlotMap<Transform>::Handle owned_transform;
 
         // Contains all the data needed to run the OpenGL pipeline:
         struct Pipeline
@@ -130,10 +133,16 @@ struct Scene
     };
 
     // Scenes, of course, may have many of the above objects:
-    std::list<Transform> transforms;
-    std::list<Drawable> drawables;
+    //  (transforms and drawables come and go with game objects, so they are kept in slot maps)
+    SlotMap<Transform> transforms;
+    SlotMap<Drawable> drawables;
     std::list<Camera> cameras;
     std::list<Light> lights;
+    using TransformHandle = SlotMap<Transform>::Handle;
+    using DrawableHandle = SlotMap<Drawable>::Handle;
+
+    // remove a drawable (and its owned_transform, if any); stale handles are ignored:
+    void remove_drawable(DrawableHandle drawable);
 
     // The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
     void draw(Camera const &camera) const;
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Storage for scene items (transforms, drawables) that come and go: O(1) create and destroy,
+ * generational handles that go stale instead of dangling, and a dense list of live items for iteration.
+ * Like ObjectPool, items live in fixed-size chunks, so pointers to them stay valid until they are
+ * destroyed (Scene links transforms, drawables, cameras, and lights by pointer).
+ * Iteration goes through 'live', which is contiguous and visits items in no particular order.
+ */
+template <typename T>
+struct SlotMap
+{
+    static constexpr uint32_t ChunkSize = 256;
+
+    // refers to a slot; becomes stale (get() returns nullptr) once the item is erased
+    struct Handle
+    {
+        uint32_t slot = 0xFFFFFFFFu;
+        uint32_t generation = 0;
+        bool operator==(Handle const &other) const { return slot == other.slot && generation == other.generation; }
+    };
+
+    SlotMap() = default;
+    ~SlotMap() { clear(); }
+    // items are linked by pointer, so copying is up to the owner (see Scene::set):
+    SlotMap(SlotMap const &) = delete;
+    SlotMap &operator=(SlotMap const &) = delete;
+
+    template <typename... Args>
+    Handle emplace(Args &&...args)
+    {
+        uint32_t slot;
+        if (!free_slots.empty())
+        {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        else
+        {
+            slot = uint32_t(generations.size());
+            if (slot % ChunkSize == 0)
+                chunks.emplace_back(std::make_unique<Cell[]>(ChunkSize));
+            generations.push_back(0);
+            live_index.push_back(0);
+        }
+        T *item = new (at(slot).bytes) T(std::forward<Args>(args)...);
+        live_index[slot] = uint32_t(live.size());
+        live.push_back(item);
+        live_slots.push_back(slot);
+        return Handle{slot, generations[slot]};
+    }
+    // for callers that only keep a pointer (std::list-style):
+    template <typename... Args>
+    T &emplace_back(Args &&...args)
+    {
+        return *get(emplace(std::forward<Args>(args)...));
+    }
+
+    // destroys the item; returns false if the handle was already stale
+    bool erase(Handle handle)
+    {
+        T *item = get(handle);
+        if (!item)
+            return false;
+        item->~T();
+        // swap the last live item into the hole:
+        uint32_t index = live_index[handle.slot];
+        live[index] = live.back();
+        live_slots[index] = live_slots.back();
+        live_index[live_slots[index]] = index;
+        live.pop_back();
+        live_slots.pop_back();
+
+        generations[handle.slot] += 1;
+        free_slots.push_back(handle.slot);
+        return true;
+    }
+
+    void clear()
+    {
+        while (!live.empty())
+        {
+            uint32_t slot = live_slots.back();
+            erase(Handle{slot, generations[slot]});
+        }
+    }
+
+    T *get(Handle handle)
+    {
+        if (handle.slot >= generations.size() || generations[handle.slot] != handle.generation)
+            return nullptr;
+        return std::launder(reinterpret_cast<T *>(at(handle.slot).bytes));
+    }
+    T const *get(Handle handle) const { return const_cast<SlotMap *>(this)->get(handle); }
+
+    size_t size() const { return live.size(); }
+    bool empty() const { return live.empty(); }
+
+    // iterates items by reference:
+    template <typename Item>
+    struct Iterator
+    {
+        T *const *at;
+        Item &operator*() const { return **at; }
+        Item *operator->() const { return *at; }
+        Iterator &operator++()
+        {
+            ++at;
+            return *this;
+        }
+        bool operator!=(Iterator const &other) const { return at != other.at; }
+        bool operator==(Iterator const &other) const { return at == other.at; }
+    };
+    Iterator<T> begin() { return Iterator<T>{live.data()}; }
+    Iterator<T> end() { return Iterator<T>{live.data() + live.size()}; }
+    Iterator<T const> begin() const { return Iterator<T const>{live.data()}; }
+    Iterator<T const> end() const { return Iterator<T const>{live.data() + live.size()}; }
+
+private:
+    struct Cell
+    {
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+    std::vector<std::unique_ptr<Cell[]>> chunks;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> live_index; // slot -> position in 'live'
+    std::vector<uint32_t> free_slots;
+    std::vector<T *> live;            // dense, for iteration
+    std::vector<uint32_t> live_slots; // position in 'live' -> slot
+
+    Cell &at(uint32_t slot) { return chunks[slot / ChunkSize][slot % ChunkSize]; }
+};
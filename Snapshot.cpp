@@ -0,0 +1,105 @@
+#include "Snapshot.hpp"
+
+#include "Connection.hpp"
+#include "Wire.hpp"
+#include "Game.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+static_assert(uint8_t(ObjectType::Flag) < 4, "ObjectType is sent in 2 bits");
+
+uint8_t Snapshot::Object::changed_fields(Object const &baseline) const
+{
+    // snapshots hold values already snapped to the wire grid (see Game::capture_frame), so plain compares are enough:
+    uint8_t mask = 0;
+    if (type != baseline.type)
+        mask |= Type;
+    if (position != baseline.position)
+        mask |= Position;
+    if (velocity != baseline.velocity)
+        mask |= Velocity;
+    if (scale != baseline.scale)
+        mask |= Scale;
+    if (deleted && !baseline.deleted)
+        mask |= Deleted;
+    return mask;
+}
+
+void Snapshot::Object::send(BitWriter &writer, uint8_t mask) const
+{
+    writer.write(mask, FieldBits);
+    if (mask & Type)
+        writer.write(uint32_t(type), 2);
+    if (mask & Position)
+        writer.write(NetworkObject::PositionX, NetworkObject::PositionY, position);
+    if (mask & Velocity)
+        writer.write(NetworkObject::VelocityAxis, NetworkObject::VelocityAxis, velocity);
+    if (mask & Scale)
+        writer.write(NetworkObject::ScaleAxis, NetworkObject::ScaleAxis, scale);
+}
+
+Snapshot::Object Snapshot::Object::receive(BitReader &reader, Object const &baseline)
+{
+    Object obj = baseline;
+    uint32_t mask = reader.read(FieldBits);
+    if (mask & Type)
+        obj.type = ObjectType(reader.read(2));
+    if (mask & Position)
+        obj.position = reader.read(NetworkObject::PositionX, NetworkObject::PositionY);
+    if (mask & Velocity)
+        obj.velocity = reader.read(NetworkObject::VelocityAxis, NetworkObject::VelocityAxis);
+    if (mask & Scale)
+        obj.scale = reader.read(NetworkObject::ScaleAxis, NetworkObject::ScaleAxis);
+    if (mask & Deleted)
+        obj.deleted = true;
+    return obj;
+}
+
+Snapshot::Object const *Snapshot::find(uint32_t id) const
+{
+    auto it = std::lower_bound(objects.begin(), objects.end(), id, [](Object const &o, uint32_t id)
+                               { return o.id < id; });
+    return (it != objects.end() && it->id == id) ? &*it : nullptr;
+}
+
+Player::PlayerData const *Snapshot::find_player(uint32_t id) const
+{
+    auto it = std::lower_bound(players.begin(), players.end(), id, [](auto const &p, uint32_t id)
+                               { return p.first < id; });
+    return (it != players.end() && it->first == id) ? &it->second : nullptr;
+}
+
+void SnapshotHistory::send_ack_message(Connection *connection_, uint32_t sequence)
+{
+    assert(connection_);
+    auto &connection = *connection_;
+
+    Wire::send(connection.send_buffer, uint8_t(Message::C2S_Ack), &sequence, sizeof(sequence));
+}
+
+bool SnapshotHistory::recv_ack_message(Connection *connection_)
+{
+    assert(connection_);
+    auto &connection = *connection_;
+    auto &recv_buffer = connection.recv_buffer;
+
+    // expecting a complete [type, size, body] message (see Wire):
+    Wire::Frame frame;
+    if (!Wire::peek(recv_buffer, 0, &frame) || frame.type != uint8_t(Message::C2S_Ack))
+        return false;
+    if (frame.size != 4)
+        throw std::runtime_error("Ack message with size " + std::to_string(frame.size) + " != 4!");
+
+    uint32_t sequence;
+    recv_buffer.copy(frame.header, sizeof(sequence), &sequence);
+    if (sequence >= next_sequence)
+        throw std::runtime_error("Ack for snapshot " + std::to_string(sequence) + " that was never sent!");
+    acked = std::max(acked, sequence);
+
+    // delete message from buffer:
+    recv_buffer.consume(frame.total());
+
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "GameObject.hpp"
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct Connection;
+
+/**
+ * One state message's worth of world, as a client sees it.
+ * Objects and players are kept sorted by id so two snapshots can be diffed in one pass.
+ * Sound cues are one-shot events, so they are sent next to snapshots (as S2C_Events) but never stored in one.
+ */
+struct Snapshot
+{
+    // the synced part of a NetworkObject:
+    struct Object
+    {
+        uint32_t id = 0;
+        ObjectType type = ObjectType::Obstacle;
+        glm::vec2 position = glm::vec2(0.0f, 0.0f);
+        glm::vec2 velocity = glm::vec2(0.0f, 0.0f);
+        glm::vec2 scale = glm::vec2(1.0f, 1.0f);
+        bool deleted = false;
+
+        // which fields of an object differ from its baseline (a DeltaField mask); both must be snapped to the wire grid:
+        uint8_t changed_fields(Object const &baseline) const;
+        // write mask and the fields in 'mask'; the caller writes the id:
+        void send(BitWriter &writer, uint8_t mask) const;
+        // read what send() wrote on top of 'baseline':
+        static Object receive(BitReader &reader, Object const &baseline);
+    };
+    enum DeltaField : uint8_t
+    {
+        Type = 1 << 0,
+        Position = 1 << 1,
+        Velocity = 1 << 2,
+        Scale = 1 << 3,
+        Deleted = 1 << 4, // set: the object is deleted (objects never come back)
+    };
+    static constexpr uint32_t FieldBits = 5;
+
+    uint32_t sequence = 0; // 0: empty slot, never sent
+    uint32_t input_sequence = 0; // newest controls message the server had applied for the receiving player
+    std::vector<Object> objects;
+    std::vector<std::pair<uint32_t, Player::PlayerData>> players;
+    std::vector<uint32_t> revealed_objects;
+
+    Object const *find(uint32_t id) const;
+    Player::PlayerData const *find_player(uint32_t id) const;
+};
+
+/**
+ * The last few snapshots sent to (on the server) or received from (on the client) one connection.
+ * The server writes each snapshot as a diff against the newest one the client acknowledged;
+ * the client keeps the same history so it can rebuild the world from those diffs.
+ */
+struct SnapshotHistory
+{
+    static constexpr uint32_t Size = 32;
+    std::array<Snapshot, Size> ring;
+    uint32_t next_sequence = 1; // server: sequence of the next snapshot to send
+    uint32_t acked = 0;         // server: newest sequence the client acknowledged
+    uint32_t latest = 0;        // client: newest sequence received
+
+    Snapshot const *find(uint32_t sequence) const
+    {
+        Snapshot const &s = ring[sequence % Size];
+        return (sequence != 0 && s.sequence == sequence) ? &s : nullptr;
+    }
+    Snapshot &slot(uint32_t sequence) { return ring[sequence % Size]; }
+
+    // used by client: tell the server 'sequence' arrived, so it can diff against it
+    static void send_ack_message(Connection *connection, uint32_t sequence);
+
+    // used by server:
+    // returns 'false' if no message or not an ack message,
+    // returns 'true' if read an ack message,
+    // throws on malformed ack message
+    bool recv_ack_message(Connection *connection);
+};
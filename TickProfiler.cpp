@@ -0,0 +1,114 @@
+#include "TickProfiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+static double percentile_of(std::vector<double> &values, double p)
+{
+    if (values.empty())
+        return 0.0;
+    size_t index = std::min(values.size() - 1, size_t(p * double(values.size())));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+const char *TickProfiler::phase_name(Phase phase)
+{
+    switch (phase)
+    {
+    case Poll:
+        return "poll";
+    case PollEvents:
+        return "poll_events";
+    case Update:
+        return "update";
+    case UpdatePlayer:
+        return "update_player";
+    case UpdateTorpedo:
+        return "update_torpedo";
+    case UpdateFlag:
+        return "update_flag";
+    case Capture:
+        return "capture";
+    case Send:
+        return "send";
+    case Sweep:
+        return "sweep";
+    case Tick:
+        return "tick";
+    default:
+        return "?";
+    }
+}
+
+TickProfiler::TickProfiler(std::string path_, double export_interval_) : path(std::move(path_)), export_interval(export_interval_)
+{
+    if (path.empty())
+        return;
+    csv.open(path, std::ios::out | std::ios::trunc);
+    if (!csv)
+    {
+        std::cerr << "WARNING: couldn't open '" << path << "' for tick profiling, not exporting." << std::endl;
+        return;
+    }
+    csv << "time_s,ticks,overruns";
+    for (uint8_t p = 0; p < PhaseCount; ++p)
+    {
+        const char *name = phase_name(Phase(p));
+        csv << "," << name << "_p50_ms," << name << "_p99_ms," << name << "_max_ms";
+    }
+    csv << ",queued_bytes_p50,queued_bytes_max,backlog_bytes_p50,backlog_bytes_max" << std::endl;
+}
+
+void TickProfiler::record(Phase phase, double ms)
+{
+    window.samples[phase].emplace_back(ms);
+}
+
+void TickProfiler::record_bytes(size_t queued, size_t backlog)
+{
+    window.queued.emplace_back(double(queued));
+    window.backlog.emplace_back(double(backlog));
+}
+
+void TickProfiler::end_tick(double tick_ms, double budget_ms)
+{
+    record(Tick, tick_ms);
+    window.ticks += 1;
+    if (tick_ms > budget_ms)
+        window.overruns += 1;
+
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - window_start).count() >= export_interval)
+    {
+        export_window();
+        window = Window();
+        window_start = now;
+    }
+}
+
+double TickProfiler::percentile(Phase phase, double p) const
+{
+    std::vector<double> values = window.samples[phase];
+    return percentile_of(values, p);
+}
+
+void TickProfiler::export_window()
+{
+    auto &tick = window.samples[Tick];
+    std::cout << std::fixed << std::setprecision(3)
+              << "[ticks] " << window.ticks << " ticks, " << window.overruns << " overruns, tick ms p50 "
+              << percentile_of(tick, 0.5) << " p99 " << percentile_of(tick, 0.99) << " max " << percentile_of(tick, 1.0) << std::endl;
+
+    if (!csv)
+        return;
+    csv << std::fixed << std::setprecision(4)
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+        << "," << window.ticks << "," << window.overruns;
+    for (auto &samples : window.samples)
+        csv << "," << percentile_of(samples, 0.5) << "," << percentile_of(samples, 0.99) << "," << percentile_of(samples, 1.0);
+    csv << std::setprecision(0)
+        << "," << percentile_of(window.queued, 0.5) << "," << percentile_of(window.queued, 1.0)
+        << "," << percentile_of(window.backlog, 0.5) << "," << percentile_of(window.backlog, 1.0) << std::endl;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * Server tick instrumentation.
+ * Phases record timing samples (milliseconds); every 'export_interval' seconds the
+ * p50/p99/max of each phase over that window, the number of ticks that overran
+ * Game::Tick, and the bytes queued for sending are appended as one row of a CSV file.
+ */
+struct TickProfiler
+{
+    enum Phase : uint8_t
+    {
+        Poll,          // wall time in Server::poll per tick (mostly waiting for the tick deadline)
+        PollEvents,    // time spent handling connection events per tick
+        Update,        // Game::update, per match
+        UpdatePlayer,  // Player::update summed over players, per match
+        UpdateTorpedo, // Torpedo::update summed over torpedoes, per match
+        UpdateFlag,    // Flag::update summed over flags, per match
+        Capture,       // Game::capture_frame, per match
+        Send,          // send_state_message, per connection
+        Sweep,         // remove_deleted_objects, per match
+        Tick,          // everything between two polls: all matches updated, sent and swept
+        PhaseCount
+    };
+    static const char *phase_name(Phase phase);
+
+    // 'path' may be empty to only keep the numbers in memory
+    explicit TickProfiler(std::string path = "", double export_interval = 5.0);
+
+    void record(Phase phase, double ms);
+    // bytes appended to send buffers this tick, and bytes still waiting in them:
+    void record_bytes(size_t queued, size_t backlog);
+    // call once per tick with the Tick phase time, counts an overrun if it exceeds 'budget_ms'
+    void end_tick(double tick_ms, double budget_ms);
+
+    // percentile p in [0,1] of a phase's samples in the current window:
+    double percentile(Phase phase, double p) const;
+
+    std::string path;
+    double export_interval;
+
+private:
+    struct Window
+    {
+        std::array<std::vector<double>, PhaseCount> samples;
+        std::vector<double> queued, backlog;
+        uint32_t ticks = 0;
+        uint32_t overruns = 0;
+    } window;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point window_start = start;
+    std::ofstream csv;
+
+    void export_window();
+};
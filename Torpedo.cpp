@@ -15,6 +15,8 @@ void Torpedo::init()
     NetworkObject::init();
     type = ObjectType::Torpedo;
     scale = glm::vec2(0.5f, 0.5f);
+    // at TORPEDO_SPEED a torpedo covers its own width in about two ticks, so sweep it:
+    continuous_collision = true;
     tracking = false;
     age = 0;
 }
@@ -43,7 +45,8 @@ void Torpedo::update(float elapsed, Game *game)
     if (player_hit)
     {
         // PLAY SOUND : torpeto hit
-        player_hit->take_damage(game, TORPEDO_DAMAGE, this);
+        defer([this, player_hit](Game *game)
+              { player_hit->take_damage(game, TORPEDO_DAMAGE, this); });
     }
     if (hits.size() > 0)
     {
@@ -17,9 +17,11 @@ void PlayMode::update_ui(float elapsed)
     // Player flag text
     text_overlays[GUI].remove_texts([](std::string const &key)
                                     { return key.rfind("Flag_", 0) == 0; });
-    auto players = get_objects(ObjectType::Player);
-    for (auto &player : players)
+    for (auto const &entity : entities)
     {
+        NetworkObject const &player = entity.object;
+        if (player.type != ObjectType::Player)
+            continue;
         auto data = player_data.find(player.id);
         if (data != player_data.end())
         {
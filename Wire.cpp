@@ -0,0 +1,69 @@
+#include "Wire.hpp"
+
+#include <stdexcept>
+#include <string>
+
+void Wire::write_varint(ByteQueue &out, uint32_t value) {
+	while (value >= 0x80) {
+		out.push_back(uint8_t(0x80 | (value & 0x7f)));
+		value >>= 7;
+	}
+	out.push_back(uint8_t(value));
+}
+
+uint32_t Wire::read_varint(ByteQueue const &in, size_t &at, size_t end) {
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < MaxVarintBytes + 1; ++i) {
+		if (at >= end) throw std::runtime_error("Ran out of bytes reading varint.");
+		uint8_t b = in[at++];
+		value |= uint32_t(b & 0x7f) << (7 * i);
+		if (!(b & 0x80)) return value;
+	}
+	throw std::runtime_error("Varint takes more than " + std::to_string(MaxVarintBytes + 1) + " bytes.");
+}
+
+void Wire::send(ByteQueue &out, uint8_t type, void const *body, size_t size) {
+	if (size > MaxBody) throw std::runtime_error("Message of " + std::to_string(size) + " bytes is too big to frame.");
+	out.push_back(type);
+	write_varint(out, uint32_t(size));
+	out.append(body, size);
+}
+
+void Wire::send(ByteQueue &out, uint8_t type, ByteQueue const &body) {
+	if (body.size() > MaxBody) throw std::runtime_error("Message of " + std::to_string(body.size()) + " bytes is too big to frame.");
+	out.push_back(type);
+	write_varint(out, uint32_t(body.size()));
+	out.append(body, 0, body.size());
+}
+
+//(shared by both peeks; 'byte(i)' reads the i'th byte past the start of the message)
+template< typename Byte >
+static bool peek_at(size_t available, Byte const &byte, Wire::Frame *frame) {
+	if (available < 2) return false;
+	uint32_t size = 0;
+	size_t header = 1;
+	while (true) {
+		if (header > Wire::MaxVarintBytes) {
+			throw std::runtime_error("Message size takes more than " + std::to_string(Wire::MaxVarintBytes) + " bytes.");
+		}
+		if (available < header + 1) return false;
+		uint8_t b = byte(header);
+		size |= uint32_t(b & 0x7f) << (7 * (header - 1));
+		header += 1;
+		if (!(b & 0x80)) break;
+	}
+	if (available < header + size) return false;
+	frame->type = byte(0);
+	frame->header = header;
+	frame->size = size;
+	return true;
+}
+
+bool Wire::peek(ByteQueue const &in, size_t at, Frame *frame) {
+	if (at > in.size()) return false;
+	return peek_at(in.size() - at, [&](size_t i) { return in[at + i]; }, frame);
+}
+
+bool Wire::peek(uint8_t const *data, size_t size, Frame *frame) {
+	return peek_at(size, [&](size_t i) { return data[i]; }, frame);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ByteQueue.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+//Framing shared by every message (and by the transports, which need to find message boundaries):
+// [type:1][body size: varint][body...]
+//The varint is LEB128: seven bits per byte, low bits first, high bit set on every byte but the last,
+// so bodies under 128 bytes cost a two-byte header. Headers longer than MaxVarintBytes are malformed.
+namespace Wire {
+	constexpr uint32_t MaxVarintBytes = 4;
+	constexpr uint32_t MaxBody = (1u << (7 * MaxVarintBytes)) - 1;
+
+	//append a varint:
+	void write_varint(ByteQueue &out, uint32_t value);
+	//read a varint from bytes [at, end) of 'in', advancing 'at'; throws std::runtime_error if it runs past 'end' or is too long:
+	uint32_t read_varint(ByteQueue const &in, size_t &at, size_t end);
+
+	//append a whole message:
+	void send(ByteQueue &out, uint8_t type, void const *body, size_t size);
+	void send(ByteQueue &out, uint8_t type, ByteQueue const &body);
+
+	struct Frame {
+		uint8_t type = 0;
+		size_t header = 0; //bytes of type + size
+		size_t size = 0; //bytes of body
+		size_t total() const { return header + size; }
+	};
+
+	//look at the message starting at byte 'at' of 'in':
+	// returns false if it isn't all there yet; throws std::runtime_error if its header is malformed.
+	bool peek(ByteQueue const &in, size_t at, Frame *frame);
+	bool peek(uint8_t const *data, size_t size, Frame *frame);
+}
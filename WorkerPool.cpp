@@ -0,0 +1,87 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(uint32_t workers)
+{
+    threads.reserve(workers);
+    for (uint32_t i = 0; i < workers; ++i)
+        threads.emplace_back([this]()
+                             { worker_main(); });
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &t : threads)
+        t.join();
+}
+
+void WorkerPool::run(size_t count, size_t batch, std::function<void(size_t, size_t)> const &body)
+{
+    batch = std::max<size_t>(1, batch);
+    // not worth waking anyone for a single batch:
+    if (threads.empty() || count <= batch)
+    {
+        body(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &body;
+        job_count = count;
+        job_batch = batch;
+        next_index = 0;
+        pending = threads.size();
+        generation += 1;
+    }
+    wake.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]()
+              { return pending == 0; });
+    job = nullptr;
+}
+
+void WorkerPool::work()
+{
+    while (true)
+    {
+        size_t begin = next_index.fetch_add(job_batch);
+        if (begin >= job_count)
+            return;
+        (*job)(begin, std::min(begin + job_batch, job_count));
+    }
+}
+
+void WorkerPool::worker_main()
+{
+    uint64_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]()
+                      { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        work();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending -= 1;
+            if (pending == 0)
+                done.notify_one();
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads for splitting a loop across cores.
+ * parallel_for() hands out the index range in small batches; the calling thread
+ * works on the range as well and only returns once every index has been run.
+ * A pool with zero workers runs everything on the calling thread.
+ * Only one parallel_for() may be running on a pool at a time.
+ */
+struct WorkerPool
+{
+    // 'workers' extra threads; pass std::thread::hardware_concurrency() - 1 to use every core
+    explicit WorkerPool(uint32_t workers);
+    ~WorkerPool();
+    WorkerPool(WorkerPool const &) = delete;
+    WorkerPool &operator=(WorkerPool const &) = delete;
+
+    // calls f(size_t i) for every i in [0, count); f must be safe to call from several threads at once
+    // indices are handed out 'batch' at a time, so use a small batch when each call is expensive
+    template <typename F>
+    void parallel_for(size_t count, F &&f, size_t batch = Batch)
+    {
+        run(count, batch, [&](size_t begin, size_t end)
+            {
+            for (size_t i = begin; i < end; ++i)
+                f(i); });
+    }
+
+    // number of threads that run a parallel_for, including the caller
+    size_t thread_count() const { return threads.size() + 1; }
+
+    static constexpr size_t Batch = 16;
+
+private:
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake; // workers wait here for a new job
+    std::condition_variable done; // parallel_for waits here for the workers to check back in
+    uint64_t generation = 0;      // bumped for every job
+    size_t pending = 0;           // workers that haven't finished the current job
+    bool stopping = false;
+
+    std::function<void(size_t, size_t)> const *job = nullptr;
+    size_t job_count = 0;
+    size_t job_batch = Batch;
+    std::atomic<size_t> next_index{0};
+
+    void run(size_t count, size_t batch, std::function<void(size_t, size_t)> const &body);
+    void work();
+    void worker_main();
+};
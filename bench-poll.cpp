@@ -0,0 +1,208 @@
+#include "Connection.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Opens a growing number of idle localhost TCP connections to a Server and compares its pollers:
+//   - capacity: how many connections the server manages to take,
+//   - idle poll: what Server::poll(0) costs when nothing is ready,
+//   - wakeup: time from one client sending a byte to Server::poll reporting it.
+// (Linux only; the server's per-connection log lines go to stderr.)
+//   usage: ./bench-poll [max-connections] [port] 2>/dev/null
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double micros_between(Clock::time_point a, Clock::time_point b)
+    {
+        return std::chrono::duration<double, std::micro>(b - a).count();
+    }
+
+    // plain blocking socket connected to 127.0.0.1:port (or -1):
+    int connect_local(uint16_t port)
+    {
+        int s = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (s < 0)
+            return -1;
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            ::close(s);
+            return -1;
+        }
+        return s;
+    }
+
+    struct Result
+    {
+        uint32_t accepted = 0;
+        double idle_us = 0.0;
+        double wakeup_p50_us = 0.0;
+        double wakeup_p99_us = 0.0;
+    };
+
+    Result run(Poller poller, uint32_t count, uint16_t port)
+    {
+        Result result;
+        Server server(std::to_string(port), Transport::TCP, poller);
+
+        uint32_t received = 0;
+        auto on_event = [&](Connection *c, Connection::Event event)
+        {
+            if (event == Connection::OnOpen)
+                result.accepted += 1;
+            if (event == Connection::OnRecv)
+            {
+                received += uint32_t(c->recv_buffer.size());
+                c->recv_buffer.clear();
+            }
+        };
+
+        std::vector<int> clients;
+        clients.reserve(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            int s = connect_local(port);
+            if (s < 0)
+                break;
+            clients.emplace_back(s);
+            // (select accepts one connection per poll, so keep up as we go)
+            server.poll(on_event, 0.0);
+        }
+        auto give_up = Clock::now() + std::chrono::seconds(1);
+        while (result.accepted < clients.size() && Clock::now() < give_up)
+            server.poll(on_event, 0.001);
+
+        // only talk through connections the server kept (select refuses the ones past FD_SETSIZE):
+        std::unordered_map<uint16_t, int> client_by_port;
+        for (int s : clients)
+        {
+            sockaddr_in local;
+            socklen_t local_len = sizeof(local);
+            if (getsockname(s, reinterpret_cast<sockaddr *>(&local), &local_len) == 0)
+                client_by_port.emplace(local.sin_port, s);
+        }
+        std::vector<int> live;
+        for (auto const &c : server.connections)
+        {
+            if (c.socket == InvalidSocket)
+                continue;
+            sockaddr_in peer;
+            socklen_t peer_len = sizeof(peer);
+            if (getpeername(c.socket, reinterpret_cast<sockaddr *>(&peer), &peer_len) != 0)
+                continue;
+            auto f = client_by_port.find(peer.sin_port);
+            if (f != client_by_port.end())
+                live.emplace_back(f->second);
+        }
+
+        { // idle polls:
+            const uint32_t Polls = 2000;
+            auto before = Clock::now();
+            for (uint32_t i = 0; i < Polls; ++i)
+                server.poll(on_event, 0.0);
+            result.idle_us = micros_between(before, Clock::now()) / Polls;
+        }
+
+        if (!live.empty())
+        { // wakeups:
+            const uint32_t Rounds = 2000;
+            std::mt19937 mt(0x5eed);
+            std::vector<double> times;
+            times.reserve(Rounds);
+            for (uint32_t i = 0; i < Rounds; ++i)
+            {
+                int s = live[mt() % live.size()];
+                uint32_t expected = received + 1;
+                char byte = 'x';
+                auto before = Clock::now();
+                if (::send(s, &byte, 1, 0) != 1)
+                    break;
+                while (received < expected)
+                    server.poll(on_event, 0.1);
+                times.emplace_back(micros_between(before, Clock::now()));
+            }
+            if (!times.empty())
+            {
+                std::sort(times.begin(), times.end());
+                result.wakeup_p50_us = times[times.size() / 2];
+                result.wakeup_p99_us = times[std::min(times.size() - 1, times.size() * 99 / 100)];
+            }
+        }
+
+        for (int s : clients)
+            ::close(s);
+        // let the server see the hangups before it goes away:
+        for (uint32_t i = 0; i < 10; ++i)
+            server.poll(on_event, 0.001);
+        for (auto &c : server.connections)
+            c.close();
+        return result;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t max_connections = 4000;
+    uint16_t port = 15400;
+    if (argc > 3)
+    {
+        std::cerr << "Usage:\n\t./bench-poll [max-connections] [port]" << std::endl;
+        return 1;
+    }
+    if (argc >= 2)
+        max_connections = uint32_t(std::max(1, std::stoi(argv[1])));
+    if (argc >= 3)
+        port = uint16_t(std::stoi(argv[2]));
+
+    { // each connection is two sockets here, so ask for all the descriptors we're allowed:
+        rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+            getrlimit(RLIMIT_NOFILE, &limit);
+            std::cout << "descriptor limit: " << limit.rlim_cur << std::endl;
+        }
+    }
+
+    std::vector<uint32_t> counts;
+    for (uint32_t count = 10; count < max_connections; count *= 10)
+        counts.emplace_back(count);
+    counts.emplace_back(max_connections);
+
+    std::cout << std::setw(8) << "poller" << std::setw(8) << "conns" << std::setw(10) << "accepted"
+              << std::setw(12) << "idle(us)" << std::setw(12) << "wake p50" << std::setw(12) << "wake p99" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (uint32_t count : counts)
+    {
+        for (Poller poller : {Poller::Select, Poller::Epoll})
+        {
+            Result result = run(poller, count, port);
+            // (a fresh port per run, since Server doesn't close its listen socket)
+            port += 1;
+            std::cout << std::setw(8) << (poller == Poller::Select ? "select" : "epoll")
+                      << std::setw(8) << count << std::setw(10) << result.accepted
+                      << std::setw(12) << result.idle_us << std::setw(12) << result.wakeup_p50_us
+                      << std::setw(12) << result.wakeup_p99_us << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include "Game.hpp"
+#include "Scene.hpp"
+#include "WorkerPool.hpp"
+#include "data_path.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs Game::update headless on prototype.scene with a growing number of live objects
+// and reports how long a tick takes, serially and on a worker pool.
+// The parallel run must end in exactly the same state as the serial one.
+//   usage: ./bench-tick [ticks-per-run] [worker-threads]
+int main(int argc, char **argv)
+{
+    int ticks = 300;
+    uint32_t worker_threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    if (argc > 3)
+    {
+        std::cerr << "Usage:\n\t./bench-tick [ticks-per-run] [worker-threads]" << std::endl;
+        return 1;
+    }
+    if (argc >= 2)
+        ticks = std::max(1, std::stoi(argv[1]));
+    if (argc >= 3)
+        worker_threads = uint32_t(std::stoul(argv[2]));
+
+    std::vector<GameObject> obstacles;
+    auto on_drawable = [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name)
+    {
+        obstacles.emplace_back(transform->position, transform->scale);
+    };
+    Scene(data_path("prototype.scene"), on_drawable);
+
+    BBox level_box = obstacles.at(0).get_BBox();
+    for (auto const &o : obstacles)
+        level_box.enclose(o.get_BBox());
+
+    WorkerPool workers(worker_threads);
+
+    struct Result
+    {
+        std::vector<double> times;
+        uint64_t state_hash = 0;
+    };
+
+    // plays 'ticks' ticks of a match with 'count' live objects:
+    auto run = [&](size_t count, WorkerPool *pool)
+    {
+        Game game;
+        game.workers = pool;
+        game.bvh->build(std::vector<GameObject>(obstacles));
+
+        std::mt19937 mt(0xbe9c4);
+        std::uniform_real_distribution<float> rand_x(level_box.min.x, level_box.max.x);
+        std::uniform_real_distribution<float> rand_y(level_box.min.y, level_box.max.y);
+        std::uniform_int_distribution<int> rand_dir(0, 3);
+
+        // a quarter of the objects are subs driving around and firing, the rest are torpedoes:
+        size_t player_count = std::max<size_t>(1, count / 4);
+        for (size_t i = 0; i < player_count; ++i)
+        {
+            Player *player = game.spawn_object<Player>();
+            player->position = player->data.spawn_pos = glm::vec2(rand_x(mt), rand_y(mt));
+            player->controls.jump.pressed = true;
+        }
+        auto top_up_torpedoes = [&]()
+        {
+            while (game.object_count() < count)
+            {
+                Torpedo *torp = game.spawn_object<Torpedo>();
+                torp->position = glm::vec2(rand_x(mt), rand_y(mt));
+                torp->velocity = glm::vec2(rand_dir(mt) < 2 ? 1 : -1, 0) * Torpedo::TORPEDO_SPEED;
+                torp->owner = 0;
+            }
+        };
+
+        Result result;
+        result.times.reserve(ticks);
+        for (int t = 0; t < ticks; ++t)
+        {
+            if (t % 30 == 0)
+            {
+                for (Player *player : game.get_objects<Player>())
+                {
+                    int dir = rand_dir(mt);
+                    player->controls.left.pressed = (dir == 0);
+                    player->controls.right.pressed = (dir == 1);
+                    player->controls.up.pressed = (dir == 2);
+                    player->controls.down.pressed = (dir == 3);
+                }
+            }
+            top_up_torpedoes();
+
+            auto before = std::chrono::steady_clock::now();
+            game.update(Game::Tick);
+            auto after = std::chrono::steady_clock::now();
+            result.times.emplace_back(std::chrono::duration<double, std::milli>(after - before).count());
+
+            game.remove_deleted_objects();
+            game.for_each_object([](NetworkObject *g)
+                                 { g->sound_cues = 0; });
+        }
+
+        // FNV-1a over everything that would be sent to clients:
+        result.state_hash = 0xcbf29ce484222325ull;
+        auto mix = [&](auto const &value)
+        {
+            uint8_t bytes[sizeof(value)];
+            std::memcpy(bytes, &value, sizeof(value));
+            for (uint8_t b : bytes)
+                result.state_hash = (result.state_hash ^ b) * 0x100000001b3ull;
+        };
+        game.for_each_object([&](NetworkObject *obj)
+                             {
+            mix(obj->id);
+            mix(obj->position);
+            mix(obj->velocity); });
+        for (Player *player : game.get_objects<Player>())
+        {
+            mix(player->data.hp);
+            mix(player->data.flag_count);
+        }
+        return result;
+    };
+
+    auto stats = [](std::vector<double> times)
+    {
+        double total = 0.0;
+        for (double v : times)
+            total += v;
+        std::sort(times.begin(), times.end());
+        std::cout << std::setw(14) << std::fixed << std::setprecision(4) << total / times.size()
+                  << std::setw(14) << times[std::min(times.size() - 1, times.size() * 99 / 100)]
+                  << std::setw(14) << times.back();
+    };
+
+    // the game logs every hit and spawn, which would swamp the timings:
+    std::streambuf *cout_buf = std::cout.rdbuf();
+
+    std::cout << "serial vs. " << workers.thread_count() << " threads, ms/tick" << std::endl;
+    std::cout << std::setw(10) << "objects"
+              << std::setw(14) << "serial avg" << std::setw(14) << "serial p99" << std::setw(14) << "serial max"
+              << std::setw(14) << "pool avg" << std::setw(14) << "pool p99" << std::setw(14) << "pool max"
+              << std::setw(8) << "same" << std::endl;
+    bool all_same = true;
+    for (size_t count : {10, 50, 100, 250, 500, 1000, 2000})
+    {
+        std::cout.rdbuf(nullptr);
+        Result serial = run(count, nullptr);
+        Result pooled = run(count, &workers);
+        std::cout.rdbuf(cout_buf);
+
+        bool same = (serial.state_hash == pooled.state_hash);
+        all_same = all_same && same;
+        std::cout << std::setw(10) << count;
+        stats(serial.times);
+        stats(pooled.times);
+        std::cout << std::setw(8) << (same ? "yes" : "NO") << std::endl;
+    }
+
+    return all_same ? 0 : 1;
+}
@@ -36,13 +36,20 @@ int main(int argc, char **argv) {
 	try {
 #endif
 	//------------ command line arguments ------------
+	//"--udp" ahead of the rest picks the datagram transport (the server must use it too):
+	Transport transport = Transport::TCP;
+	if (argc >= 2 && std::string(argv[1]) == "--udp") {
+		transport = Transport::UDP;
+		argv += 1;
+		argc -= 1;
+	}
 	if (argc != 3) {
-		std::cerr << "Usage:\n\t./client <host> <port>" << std::endl;
+		std::cerr << "Usage:\n\t./client [--udp] <host> <port>" << std::endl;
 		return 1;
 	}
 
 	//------------ connect to server --------------
-	Client client(argv[1], argv[2]);
+	Client client(argv[1], argv[2], transport);
 
 	//------------  initialization ------------
 
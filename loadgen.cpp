@@ -0,0 +1,243 @@
+#include "Connection.hpp"
+#include "Wire.hpp"
+#include "Game.hpp"
+#include "GameObject.hpp"
+#include "Input.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Headless bots for putting load on a server:
+// opens <bots> connections, drives each bot's sub with scripted or random controls,
+// decodes every state message like PlayMode does, and reports
+//   - tick jitter: how far the gap between state messages strays from Game::Tick,
+//   - snapshot bytes per client,
+//   - input latency: time from a bot changing direction to its sub moving that way in a snapshot.
+//   usage: ./loadgen [--udp] <host> <port> <bots> [seconds] [script|random]
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double seconds_between(Clock::time_point a, Clock::time_point b)
+    {
+        return std::chrono::duration<double>(b - a).count();
+    }
+
+    struct Bot
+    {
+        std::unique_ptr<Client> client;
+        Player::Controls controls;
+        InputSender inputs;
+        Level level;
+        SnapshotHistory snapshot_history;
+
+        glm::vec2 heading = glm::vec2(0.0f); // direction the controls currently ask for
+        Clock::time_point heading_changed;   // when the heading last changed
+        bool awaiting_response = false;      // heading changed but no snapshot has shown it yet
+        Clock::time_point next_change;
+        uint32_t script_step = 0;
+
+        bool have_snapshot = false;
+        Clock::time_point last_snapshot;
+    };
+
+    // press exactly the buttons for 'dir' (0 left, 1 right, 2 up, 3 down):
+    void steer(Bot &bot, int dir, Clock::time_point now)
+    {
+        static const glm::vec2 headings[4] = {{-1, 0}, {1, 0}, {0, 1}, {0, -1}};
+        bot.controls.left.pressed = (dir == 0);
+        bot.controls.right.pressed = (dir == 1);
+        bot.controls.up.pressed = (dir == 2);
+        bot.controls.down.pressed = (dir == 3);
+        if (headings[dir] != bot.heading)
+        {
+            bot.heading = headings[dir];
+            bot.heading_changed = now;
+            bot.awaiting_response = true;
+        }
+    }
+
+    // p in [0,1] of an unsorted list:
+    double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+            return 0.0;
+        std::sort(values.begin(), values.end());
+        return values[std::min(values.size() - 1, size_t(p * double(values.size())))];
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Transport transport = Transport::TCP;
+    if (argc >= 2 && std::string(argv[1]) == "--udp")
+    {
+        transport = Transport::UDP;
+        argv += 1;
+        argc -= 1;
+    }
+    if (argc < 4 || argc > 6)
+    {
+        std::cerr << "Usage:\n\t./loadgen [--udp] <host> <port> <bots> [seconds] [script|random]" << std::endl;
+        return 1;
+    }
+    std::string host = argv[1];
+    std::string port = argv[2];
+    size_t bot_count = std::max(1, std::stoi(argv[3]));
+    double duration = (argc >= 5) ? std::stod(argv[4]) : 30.0;
+    bool random_controls = true;
+    if (argc >= 6)
+    {
+        std::string mode = argv[5];
+        if (mode == "script")
+            random_controls = false;
+        else if (mode != "random")
+        {
+            std::cerr << "Controls must be 'script' or 'random', not '" << mode << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    std::mt19937 mt(0x10adf00d);
+    std::uniform_int_distribution<int> rand_dir(0, 3);
+    std::uniform_real_distribution<double> rand_hold(0.25, 2.0);
+    std::uniform_int_distribution<int> rand_fire(0, 3);
+
+    std::vector<Bot> bots(bot_count);
+    auto start = Clock::now();
+    for (size_t i = 0; i < bots.size(); ++i)
+    {
+        bots[i].client = std::make_unique<Client>(host, port, transport);
+        Game::send_hello_message(&bots[i].client->connection);
+        bots[i].next_change = start;
+    }
+    std::cout << "Connected " << bots.size() << " bots to " << host << ":" << port << "." << std::endl;
+
+    std::vector<double> tick_gaps_ms;
+    std::vector<double> latencies_ms;
+    size_t snapshot_bytes = 0;
+    size_t snapshots = 0;
+
+    // controls are sampled at the rate a fast client renders (InputSender decides what actually goes out):
+    const double SendInterval = 1.0 / 60.0;
+    auto next_send = start;
+
+    while (true)
+    {
+        auto now = Clock::now();
+        if (seconds_between(start, now) > duration)
+            break;
+
+        bool send = (now >= next_send);
+        if (send)
+            next_send += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(SendInterval));
+
+        for (auto &bot : bots)
+        {
+            if (now >= bot.next_change)
+            {
+                if (random_controls)
+                {
+                    steer(bot, rand_dir(mt), now);
+                    bot.controls.jump.pressed = (rand_fire(mt) == 0);
+                    bot.next_change = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(rand_hold(mt)));
+                }
+                else
+                {
+                    // drive a square, firing on every corner:
+                    static const int square[4] = {1, 2, 0, 3};
+                    steer(bot, square[bot.script_step % 4], now);
+                    bot.controls.jump.pressed = true;
+                    bot.script_step += 1;
+                    bot.next_change = now + std::chrono::seconds(1);
+                }
+            }
+            if (send)
+            {
+                bot.inputs.update(float(SendInterval), bot.controls);
+                bot.inputs.send_controls_message(&bot.client->connection);
+                bot.controls.jump.downs = 0;
+            }
+
+            bot.client->poll([&](Connection *c, Connection::Event event)
+                             {
+                if (event == Connection::OnOpen)
+                    return;
+                if (event == Connection::OnClose)
+                {
+                    std::cerr << "Lost connection to server!" << std::endl;
+                    std::exit(1);
+                }
+                assert(event == Connection::OnRecv);
+                while (true)
+                {
+                    Wire::Frame frame;
+                    if (!Wire::peek(c->recv_buffer, 0, &frame))
+                        break;
+
+                    bool first = true;
+                    glm::vec2 velocity(0.0f);
+                    auto on_object = [&](NetworkObject &obj)
+                    {
+                        if (first)
+                            velocity = obj.velocity;
+                        first = false;
+                    };
+                    auto on_player_data = [](uint32_t, Player::PlayerData &) {};
+                    if (Game::recv_welcome_message(c))
+                        continue;
+                    // bots don't play sounds:
+                    if (Game::recv_events_message(c, [](NetworkObject &) {}))
+                        continue;
+                    if (!Game::recv_state_message(c, on_object, on_player_data, bot.level, bot.snapshot_history))
+                        break;
+                    bot.inputs.acknowledge(bot.snapshot_history.find(bot.snapshot_history.latest)->input_sequence);
+
+                    auto received = Clock::now();
+                    snapshots += 1;
+                    snapshot_bytes += frame.total();
+                    if (bot.have_snapshot)
+                        tick_gaps_ms.emplace_back(1000.0 * seconds_between(bot.last_snapshot, received));
+                    bot.have_snapshot = true;
+                    bot.last_snapshot = received;
+
+                    // the sub has responded once it moves the way the controls point:
+                    if (bot.awaiting_response && glm::dot(velocity, bot.heading) > 0.5f * glm::length(velocity) && glm::length(velocity) > 1e-3f)
+                    {
+                        latencies_ms.emplace_back(1000.0 * seconds_between(bot.heading_changed, received));
+                        bot.awaiting_response = false;
+                    }
+                } }, 0.0);
+        }
+
+        // don't spin a core while waiting on the network:
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    double elapsed = seconds_between(start, Clock::now());
+    std::vector<double> jitter_ms;
+    jitter_ms.reserve(tick_gaps_ms.size());
+    for (double gap : tick_gaps_ms)
+        jitter_ms.emplace_back(std::abs(gap - 1000.0 * Game::Tick));
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << bots.size() << " bots for " << elapsed << "s, " << snapshots << " snapshots" << std::endl;
+    std::cout << "  tick gap ms     p50 " << percentile(tick_gaps_ms, 0.5) << "  p99 " << percentile(tick_gaps_ms, 0.99) << "  max " << percentile(tick_gaps_ms, 1.0) << "  (target " << 1000.0 * Game::Tick << ")" << std::endl;
+    std::cout << "  tick jitter ms  p50 " << percentile(jitter_ms, 0.5) << "  p99 " << percentile(jitter_ms, 0.99) << "  max " << percentile(jitter_ms, 1.0) << std::endl;
+    std::cout << "  snapshot bytes  " << (snapshots ? snapshot_bytes / snapshots : 0) << " avg/snapshot, "
+              << (elapsed > 0.0 ? snapshot_bytes / elapsed / bots.size() / 1024.0 : 0.0) << " KiB/s per client" << std::endl;
+    std::cout << "  input latency ms p50 " << percentile(latencies_ms, 0.5) << "  p90 " << percentile(latencies_ms, 0.9) << "  p99 " << percentile(latencies_ms, 0.99) << "  (" << latencies_ms.size() << " samples)" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,567 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Localhost proxy that makes a dev box's network behave like a real one:
+// clients (the real client, loadgen, ...) connect to it instead of the server, and everything it forwards
+// is delayed, dropped, reordered, and throttled, separately in each direction of each connection.
+//   e.g. ./server 15466 & ./netsim 15467 localhost 15466 --latency 50 --jitter 10 --loss 2 & ./client localhost 15467
+// With --udp, each datagram meets its own fate (jitter alone can reorder them).
+// With TCP the stream stays in order, so a lost segment instead stalls everything behind it for a retransmit, like TCP would,
+// and a full bottleneck queue stops the proxy reading from the sender, so the sender's socket backs up as it would for real.
+// Each direction of a TCP connection ends separately: when one end hangs up, what it sent still arrives before the other end hears so.
+// Fates are drawn from a generator seeded per connection (--seed), so the same traffic meets the same conditions
+// on every run; only the bandwidth queue depends on when packets actually arrive.
+// (Linux only.)
+//   usage: ./netsim [--udp] [options] <listen-port> <server-host> <server-port>
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double now_seconds()
+    {
+        return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+    }
+
+    // what one direction of a connection goes through:
+    struct Conditions
+    {
+        double latency = 0.0;   // seconds, one way
+        double jitter = 0.0;    // seconds; each packet's delay is latency, give or take up to this much
+        double loss = 0.0;      // chance a packet is lost
+        double reorder = 0.0;   // chance a packet is held back an extra ReorderHold, so the ones behind it pass
+        double bandwidth = 0.0; // bytes per second through the bottleneck (0: unlimited)
+        double queue = 0.1;     // seconds of sending the bottleneck buffers before dropping (UDP) or making the sender wait (TCP)
+    };
+    constexpr double ReorderHold = 0.02;
+    constexpr double MinRetransmit = 0.2; // (Linux's minimum retransmit timeout)
+    constexpr size_t Segment = 1448;      // TCP: the stream is forwarded in pieces of at most this size
+    constexpr double UdpTimeout = 30.0;   // forget UDP peers that are quiet this long
+    constexpr size_t NotPolled = size_t(-1);
+
+    // totals for one direction, over all connections:
+    struct Stats
+    {
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        uint64_t lost = 0;       // UDP: dropped at random; TCP: retransmitted
+        uint64_t overflowed = 0; // UDP: dropped because the bottleneck queue was full
+        uint64_t held = 0;       // held back to reorder
+        uint64_t delivered = 0;
+        double delay = 0.0; // summed over delivered packets
+    };
+
+    struct Packet
+    {
+        double due = 0.0;
+        double arrived = 0.0;
+        uint64_t order = 0;
+        std::vector<uint8_t> data;
+    };
+    struct Later
+    {
+        bool operator()(Packet const &a, Packet const &b) const
+        {
+            return a.due > b.due || (a.due == b.due && a.order > b.order);
+        }
+    };
+
+    // one direction of one connection:
+    struct Link
+    {
+        Conditions conditions;
+        bool stream = false; // TCP: keep order, and turn losses into retransmit stalls
+        std::mt19937 mt;
+        std::priority_queue<Packet, std::vector<Packet>, Later> in_flight;
+        double wire_free = 0.0; // when the bottleneck will have sent everything queued so far
+        double last_due = 0.0;  // stream: packets can't pass each other
+        uint64_t next_order = 0;
+        Stats *stats = nullptr;
+        bool ended = false; // stream: the sender hung up; pass that on once everything before it is through
+        bool shut = false;  // stream: ...which has happened (shutdown())
+
+        void push(double now, uint8_t const *data, size_t size)
+        {
+            Conditions const &c = conditions;
+            stats->packets += 1;
+            stats->bytes += size;
+
+            // (always three draws per packet, so one packet's fate never shifts the next one's)
+            std::uniform_real_distribution<double> chance(0.0, 1.0);
+            double lose = chance(mt);
+            double shake = chance(mt);
+            double hold = chance(mt);
+
+            double sent = now;
+            if (c.bandwidth > 0.0)
+            {
+                double start = std::max(now, wire_free);
+                if (!stream && start - now > c.queue)
+                {
+                    stats->overflowed += 1;
+                    return;
+                }
+                wire_free = start + double(size) / c.bandwidth;
+                sent = wire_free;
+            }
+            double due = sent + std::max(0.0, c.latency + c.jitter * (2.0 * shake - 1.0));
+
+            if (stream)
+            {
+                if (lose < c.loss)
+                {
+                    stats->lost += 1;
+                    due += std::max(MinRetransmit, 2.0 * (c.latency + c.jitter));
+                }
+                due = std::max(due, last_due);
+                last_due = due;
+            }
+            else
+            {
+                if (lose < c.loss)
+                {
+                    stats->lost += 1;
+                    return;
+                }
+                if (hold < c.reorder)
+                {
+                    stats->held += 1;
+                    due += ReorderHold;
+                }
+            }
+            in_flight.push(Packet{due, now, next_order++, std::vector<uint8_t>(data, data + size)});
+        }
+
+        // the next packet due by 'now', if any:
+        bool pop(double now, std::vector<uint8_t> *data)
+        {
+            if (in_flight.empty() || in_flight.top().due > now)
+                return false;
+            Packet const &top = in_flight.top();
+            stats->delivered += 1;
+            stats->delay += now - top.arrived;
+            *data = std::move(const_cast<Packet &>(top).data);
+            in_flight.pop();
+            return true;
+        }
+
+        double next_due() const
+        {
+            return in_flight.empty() ? 1e30 : in_flight.top().due;
+        }
+
+        // stream: the bottleneck has more than 'queue' to send, so leave the rest with the sender for now:
+        bool backed_up(double now) const
+        {
+            return stream && conditions.bandwidth > 0.0 && wire_free - now > conditions.queue;
+        }
+    };
+
+    // one client's connection through the proxy:
+    struct Flow
+    {
+        uint32_t id = 0;
+        int upstream = -1;         // to the server
+        int downstream = -1;       // TCP: to the client (UDP: everything goes out the listen socket)
+        std::vector<uint8_t> peer; // UDP: the client's address
+        Link up;                   // client -> server
+        Link down;                 // server -> client
+        std::vector<uint8_t> up_pending, down_pending; // TCP: let through by the link, not yet taken by the socket
+        double last_heard = 0.0;
+        bool closed = false;
+        size_t polled = NotPolled; // where its sockets are in this wait's pollfds (upstream, then TCP's downstream)
+    };
+
+    int listen_on(std::string const &port, bool udp)
+    {
+        // (one dual-stack socket, so clients reach it whether "localhost" resolves to ::1 or 127.0.0.1)
+        int s = ::socket(AF_INET6, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+        if (s < 0)
+            return -1;
+        int zero = 0, one = 1;
+        setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in6 addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons(uint16_t(std::stoul(port)));
+        if (::bind(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || (!udp && ::listen(s, SOMAXCONN) != 0))
+        {
+            ::close(s);
+            return -1;
+        }
+        fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+        return s;
+    }
+
+    // a socket connected to the server (or -1), trying each of its addresses like Client does:
+    int connect_upstream(std::string const &host, std::string const &port, bool udp)
+    {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+        addrinfo *res = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)
+            return -1;
+        int s = -1;
+        for (addrinfo *info = res; info != nullptr; info = info->ai_next)
+        {
+            s = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+            if (s < 0)
+                continue;
+            if (::connect(s, info->ai_addr, info->ai_addrlen) == 0)
+                break;
+            ::close(s);
+            s = -1;
+        }
+        freeaddrinfo(res);
+        if (s >= 0)
+            fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+        return s;
+    }
+
+    // write as much of 'pending' as the socket takes; false if the socket failed:
+    bool flush(int s, std::vector<uint8_t> &pending)
+    {
+        while (!pending.empty())
+        {
+            ssize_t ret = ::send(s, pending.data(), pending.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (ret < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            pending.erase(pending.begin(), pending.begin() + ret);
+        }
+        return true;
+    }
+
+    void print_stats(char const *name, Stats const &s, double seconds)
+    {
+        double delay_ms = s.delivered ? 1000.0 * s.delay / double(s.delivered) : 0.0;
+        auto percent = [&](uint64_t n)
+        { return s.packets ? 100.0 * double(n) / double(s.packets) : 0.0; };
+        std::cout << "  " << name << ": " << s.packets << " packets, "
+                  << double(s.bytes) / 1024.0 / seconds << " KiB/s, "
+                  << percent(s.lost) << "% lost, "
+                  << percent(s.overflowed) << "% overflowed, "
+                  << percent(s.held) << "% held back, "
+                  << delay_ms << " ms average delay" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // options ahead of the rest (times in milliseconds, chances in percent):
+    bool udp = false;
+    Conditions conditions;
+    uint32_t seed = 1;
+    double stats_interval = 5.0;
+    while (argc >= 2 && std::string(argv[1]).rfind("--", 0) == 0)
+    {
+        std::string option = argv[1];
+        if (option == "--udp")
+        {
+            udp = true;
+        }
+        else if (argc >= 3 && (option == "--latency" || option == "--jitter" || option == "--loss" || option == "--reorder" || option == "--bandwidth" || option == "--queue" || option == "--seed" || option == "--stats"))
+        {
+            double value = std::stod(argv[2]);
+            if (option == "--latency")
+                conditions.latency = value / 1000.0;
+            else if (option == "--jitter")
+                conditions.jitter = value / 1000.0;
+            else if (option == "--loss")
+                conditions.loss = value / 100.0;
+            else if (option == "--reorder")
+                conditions.reorder = value / 100.0;
+            else if (option == "--bandwidth")
+                conditions.bandwidth = value * 1000.0 / 8.0; // (kbit/s)
+            else if (option == "--queue")
+                conditions.queue = value / 1000.0;
+            else if (option == "--seed")
+                seed = uint32_t(value);
+            else
+                stats_interval = value;
+            argv += 1;
+            argc -= 1;
+        }
+        else
+        {
+            argc = 0; // (unknown option: print usage)
+            break;
+        }
+        argv += 1;
+        argc -= 1;
+    }
+    if (argc != 4)
+    {
+        std::cerr << "Usage:\n\t./netsim [--udp] [--latency ms] [--jitter ms] [--loss %] [--reorder %] [--bandwidth kbit/s] [--queue ms] [--seed n] [--stats seconds]"
+                     " <listen-port> <server-host> <server-port>\n"
+                     "Conditions apply to each direction of each connection separately." << std::endl;
+        return 1;
+    }
+    std::string listen_port = argv[1];
+    std::string host = argv[2];
+    std::string port = argv[3];
+
+    int listener = listen_on(listen_port, udp);
+    if (listener < 0)
+    {
+        std::cerr << "Failed to listen on port " << listen_port << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    std::cout << "Forwarding " << (udp ? "UDP" : "TCP") << " port " << listen_port << " to " << host << ":" << port
+              << " (latency " << conditions.latency * 1000.0 << " ms, jitter " << conditions.jitter * 1000.0 << " ms, loss "
+              << conditions.loss * 100.0 << "%, reorder " << conditions.reorder * 100.0 << "%, bandwidth ";
+    if (conditions.bandwidth > 0.0)
+        std::cout << conditions.bandwidth * 8.0 / 1000.0 << " kbit/s";
+    else
+        std::cout << "unlimited";
+    std::cout << ", seed " << seed << ")." << std::endl;
+
+    std::list<Flow> flows;
+    uint32_t next_flow = 0;
+    Stats up_stats, down_stats;
+
+    auto open_flow = [&](int downstream, uint8_t const *peer, size_t peer_size) -> Flow *
+    {
+        int upstream = connect_upstream(host, port, udp);
+        if (upstream < 0)
+        {
+            std::cerr << "Couldn't reach " << host << ":" << port << "; dropping client." << std::endl;
+            return nullptr;
+        }
+        flows.emplace_back();
+        Flow &flow = flows.back();
+        flow.id = next_flow++;
+        flow.upstream = upstream;
+        flow.downstream = downstream;
+        flow.peer.assign(peer, peer + peer_size);
+        flow.last_heard = now_seconds();
+        // (each connection, and each direction, gets its own repeatable fates)
+        flow.up.conditions = flow.down.conditions = conditions;
+        flow.up.stream = flow.down.stream = !udp;
+        flow.up.mt.seed(seed * 2654435761u + 2 * flow.id);
+        flow.down.mt.seed(seed * 2654435761u + 2 * flow.id + 1);
+        flow.up.stats = &up_stats;
+        flow.down.stats = &down_stats;
+        std::cout << "connection " << flow.id << " opened (" << flows.size() << " open)" << std::endl;
+        return &flow;
+    };
+    auto close_flow = [&](Flow &flow)
+    {
+        if (flow.closed)
+            return;
+        ::close(flow.upstream);
+        if (!udp)
+            ::close(flow.downstream);
+        flow.closed = true;
+        std::cout << "connection " << flow.id << " closed" << std::endl;
+    };
+    // TCP: once everything one end sent before hanging up has gone out the other side, hang that side up too:
+    auto pass_on_end = [&](Link &link, int to, std::vector<uint8_t> const &pending)
+    {
+        if (!link.ended || link.shut || !link.in_flight.empty() || !pending.empty())
+            return;
+        ::shutdown(to, SHUT_WR);
+        link.shut = true;
+    };
+
+    std::vector<uint8_t> buffer(65536);
+    std::vector<pollfd> pollfds;
+    std::vector<uint8_t> packet;
+    double last_stats = now_seconds();
+    while (true)
+    {
+        double now = now_seconds();
+
+        // let through whatever is due:
+        for (auto &flow : flows)
+        {
+            if (flow.closed)
+                continue;
+            while (flow.up.pop(now, &packet))
+            {
+                if (udp)
+                    ::send(flow.upstream, packet.data(), packet.size(), MSG_DONTWAIT);
+                else
+                    flow.up_pending.insert(flow.up_pending.end(), packet.begin(), packet.end());
+            }
+            while (flow.down.pop(now, &packet))
+            {
+                if (udp)
+                    ::sendto(listener, packet.data(), packet.size(), MSG_DONTWAIT, reinterpret_cast<sockaddr const *>(flow.peer.data()), socklen_t(flow.peer.size()));
+                else
+                    flow.down_pending.insert(flow.down_pending.end(), packet.begin(), packet.end());
+            }
+            if (!udp && !(flush(flow.upstream, flow.up_pending) && flush(flow.downstream, flow.down_pending)))
+                close_flow(flow);
+            if (!udp && !flow.closed)
+            {
+                pass_on_end(flow.up, flow.upstream, flow.up_pending);
+                pass_on_end(flow.down, flow.downstream, flow.down_pending);
+                if (flow.up.shut && flow.down.shut)
+                    close_flow(flow);
+            }
+            if (udp && now - flow.last_heard > UdpTimeout)
+                close_flow(flow);
+        }
+        flows.remove_if([](Flow const &flow)
+                        { return flow.closed; });
+
+        if (stats_interval > 0.0 && now - last_stats >= stats_interval)
+        {
+            std::cout << std::fixed << std::setprecision(1) << flows.size() << " connections over the last " << now - last_stats << " s:" << std::endl;
+            print_stats("client -> server", up_stats, now - last_stats);
+            print_stats("server -> client", down_stats, now - last_stats);
+            std::cout.unsetf(std::ios::floatfield);
+            up_stats = Stats();
+            down_stats = Stats();
+            last_stats = now;
+        }
+
+        // wait for traffic, or for the next packet to come due:
+        // (poll() rather than select(), since a few hundred loadgen bots over TCP take more descriptors than an fd_set holds)
+        pollfds.clear();
+        pollfds.push_back(pollfd{listener, POLLIN, 0});
+        double wake = now + 0.1;
+        // TCP: read a socket only while its end is still sending and the link it feeds has room
+        // (a socket with nothing to wait for is left out, as poll() would report its hangup over and over):
+        auto watch = [&](int s, Link &reading, std::vector<uint8_t> const &pending)
+        {
+            short events = short(pending.empty() ? 0 : POLLOUT);
+            if (reading.backed_up(now))
+                wake = std::min(wake, reading.wire_free - reading.conditions.queue);
+            else if (!reading.ended)
+                events |= POLLIN;
+            pollfds.push_back(pollfd{events ? s : -1, events, 0});
+        };
+        for (auto &flow : flows)
+        {
+            flow.polled = pollfds.size();
+            if (udp)
+            {
+                pollfds.push_back(pollfd{flow.upstream, POLLIN, 0});
+            }
+            else
+            {
+                watch(flow.upstream, flow.down, flow.up_pending);
+                watch(flow.downstream, flow.up, flow.down_pending);
+            }
+            wake = std::min({wake, flow.up.next_due(), flow.down.next_due()});
+        }
+        // (rounded up, so a wakeup is never just before a packet is due)
+        int wait_ms = int(std::ceil(std::max(0.0, wake - now) * 1000.0));
+        if (::poll(pollfds.data(), nfds_t(pollfds.size()), wait_ms) < 0 && errno != EINTR)
+        {
+            std::cerr << "poll failed: " << strerror(errno) << std::endl;
+            return 1;
+        }
+        now = now_seconds();
+        // (hangups and errors count as readable, so the read that follows notices them)
+        auto readable = [&](size_t index)
+        {
+            return index != NotPolled && (pollfds[index].events & POLLIN) && (pollfds[index].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+        };
+
+        // new connections, and traffic from clients:
+        if (readable(0))
+        {
+            while (true)
+            {
+                sockaddr_storage from;
+                socklen_t from_size = sizeof(from);
+                uint8_t const *from_bytes = reinterpret_cast<uint8_t const *>(&from);
+                if (udp)
+                {
+                    ssize_t ret = ::recvfrom(listener, buffer.data(), buffer.size(), MSG_DONTWAIT, reinterpret_cast<sockaddr *>(&from), &from_size);
+                    if (ret < 0)
+                        break;
+                    Flow *flow = nullptr;
+                    for (auto &f : flows)
+                    {
+                        if (!f.closed && f.peer.size() == size_t(from_size) && std::equal(f.peer.begin(), f.peer.end(), from_bytes))
+                        {
+                            flow = &f;
+                            break;
+                        }
+                    }
+                    if (!flow)
+                        flow = open_flow(listener, from_bytes, from_size);
+                    if (!flow)
+                        continue;
+                    flow->last_heard = now;
+                    flow->up.push(now, buffer.data(), size_t(ret));
+                }
+                else
+                {
+                    int s = ::accept(listener, reinterpret_cast<sockaddr *>(&from), &from_size);
+                    if (s < 0)
+                        break;
+                    fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+                    if (!open_flow(s, from_bytes, from_size))
+                        ::close(s);
+                }
+            }
+        }
+
+        // traffic from the server (and, over TCP, from each client):
+        auto read_stream = [&](Flow &flow, int s, Link &link)
+        {
+            while (!flow.closed && !link.backed_up(now))
+            {
+                ssize_t ret = ::recv(s, buffer.data(), buffer.size(), MSG_DONTWAIT);
+                if (ret == 0)
+                    link.ended = true;
+                if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                    close_flow(flow);
+                if (ret <= 0)
+                    break;
+                for (size_t at = 0; at < size_t(ret); at += Segment)
+                    link.push(now, buffer.data() + at, std::min(Segment, size_t(ret) - at));
+            }
+        };
+        for (auto &flow : flows)
+        {
+            if (flow.closed)
+                continue;
+            if (udp)
+            {
+                if (!readable(flow.polled))
+                    continue;
+                while (true)
+                {
+                    ssize_t ret = ::recv(flow.upstream, buffer.data(), buffer.size(), MSG_DONTWAIT);
+                    if (ret < 0)
+                        break;
+                    flow.down.push(now, buffer.data(), size_t(ret));
+                }
+            }
+            else
+            {
+                // (flows opened since the wait weren't polled)
+                if (flow.polled != NotPolled && readable(flow.polled + 1))
+                    read_stream(flow, flow.downstream, flow.up);
+                if (readable(flow.polled))
+                    read_stream(flow, flow.upstream, flow.down);
+            }
+        }
+    }
+}
@@ -5,11 +5,17 @@
 
 #include "Game.hpp"
 #include "GameObject.hpp"
+#include "MatchHost.hpp"
+#include "TickProfiler.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <iterator>
+#include <memory>
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
+#include <thread>
 #include <unordered_map>
 #include "data_path.hpp"
 
@@ -42,37 +48,80 @@ int main(int argc, char **argv)
 
         //------------ argument parsing ------------
 
-        if (argc != 2)
+        // options ahead of the rest:
+        //  "--udp" picks the datagram transport,
+        //  "--high-water <bytes>" sets how far a client's unsent data may back up before it is dropped (0: never)
+        Transport transport = Transport::TCP;
+        size_t high_water = DefaultHighWater;
+        while (argc >= 2 && std::string(argv[1]).rfind("--", 0) == 0)
         {
-            std::cerr << "Usage:\n\t./server <port>" << std::endl;
+            std::string option = argv[1];
+            if (option == "--udp")
+            {
+                transport = Transport::UDP;
+            }
+            else if (option == "--high-water" && argc >= 3)
+            {
+                high_water = size_t(std::stoull(argv[2]));
+                argv += 1;
+                argc -= 1;
+            }
+            else
+            {
+                argc = 0; // (unknown option: print usage)
+                break;
+            }
+            argv += 1;
+            argc -= 1;
+        }
+        if (argc < 2 || argc > 5)
+        {
+            std::cerr << "Usage:\n\t./server [--udp] [--high-water <bytes>] <port> [worker-threads] [players-per-match] [profile.csv]" << std::endl;
             return 1;
         }
+        // by default run matches on every core:
+        uint32_t worker_threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        if (argc >= 3)
+            worker_threads = uint32_t(std::stoul(argv[2]));
+        uint32_t players_per_match = uint32_t(std::size(Game::SpawnPos));
+        if (argc >= 4)
+            players_per_match = uint32_t(std::stoul(argv[3]));
+        // tick timings are appended here every few seconds:
+        std::string profile_path = "server-profile.csv";
+        if (argc >= 5)
+            profile_path = argv[4];
 
         //------------ initialization ------------
 
-        Server server(argv[1]);
-
-        //------------ main loop ------------
-
-        // keep track of which connection is controlling which player:
-        std::unordered_map<Connection *, Player *> connection_to_player;
-        // keep track of game state:
-        Game game;
+        Server server(argv[1], transport);
+        // a state message is a diff against what the client acknowledged, so a newer one can always replace an older one:
+        server.latest_only = {uint8_t(Message::S2C_State)};
+        server.high_water = high_water;
 
+        // the level is loaded once and shared by every match:
         std::vector<GameObject> obstacles;
         auto on_drawable = [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name)
         {
             // create collision box
-            game.static_obstacles.emplace_back(transform->position, transform->scale);
             obstacles.emplace_back(transform->position, transform->scale);
         };
         Scene(data_path("prototype.scene"), on_drawable);
-        game.bvh.build(std::move(obstacles));
+        auto static_bvh = std::make_shared<BVH>();
+        static_bvh->build(std::move(obstacles));
+
+        // keep track of matches and which connection plays in which:
+        MatchHost host(static_bvh, worker_threads, players_per_match);
+        TickProfiler profiler(profile_path);
+        host.profiler = &profiler;
+
+        //------------ main loop ------------
 
         while (true)
         {
             static auto next_tick = std::chrono::steady_clock::now() + std::chrono::duration<double>(Game::Tick);
             // process incoming data from clients until a tick has elapsed:
+            auto poll_start = std::chrono::steady_clock::now();
+            double events_ms = 0.0;
             while (true)
             {
                 auto now = std::chrono::steady_clock::now();
@@ -83,76 +132,19 @@ int main(int argc, char **argv)
                     break;
                 }
 
-                // helper used on client close (due to quit) and server close (due to error):
-                auto remove_connection = [&](Connection *c)
-                {
-                    auto f = connection_to_player.find(c);
-                    assert(f != connection_to_player.end());
-                    f->second->deleted = true;
-                    // game.remove_object(f->second->id);
-                    connection_to_player.erase(f);
-                };
-
                 server.poll([&](Connection *c, Connection::Event evt)
                             {
-				if (evt == Connection::OnOpen) {
-					//client connected:
-
-					//create some player info for them:
-                    auto player = game.spawn_object<Player>();
-                    game.init_player_spawn_info(player);
-					connection_to_player.emplace(c, player);
-                    
-
-				} else if (evt == Connection::OnClose) {
-					//client disconnected:
-
-					remove_connection(c);
-
-				} else { assert(evt == Connection::OnRecv);
-					//got data from client:
-					//std::cout << "current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush(); //DEBUG
-
-					//look up in players list:
-					auto f = connection_to_player.find(c);
-					assert(f != connection_to_player.end());
-					Player &player = *f->second;
-
-					//handle messages from client:
-					try {
-						bool handled_message;
-						do {
-							handled_message = false;
-							if (player.controls.recv_controls_message(c)) handled_message = true;
-							//TODO: extend for more message types as needed
-						} while (handled_message);
-					} catch (std::exception const &e) {
-						std::cout << "Disconnecting client:" << e.what() << std::endl;
-						c->close();
-						remove_connection(c);
-					}
-				} }, remain);
+                    auto event_start = std::chrono::steady_clock::now();
+                    host.on_event(c, evt);
+                    events_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - event_start).count(); }, remain);
             }
+            profiler.record(TickProfiler::Poll, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - poll_start).count());
+            profiler.record(TickProfiler::PollEvents, events_ms);
 
-            // update current game state
-            game.update(Game::Tick);
-
-            // send updated game state to all clients
-            for (auto &[c, player] : connection_to_player)
-            {
-                game.send_state_message(c, player);
-            }
-
-            game.game_objects.erase(
-                std::remove_if(game.game_objects.begin(), game.game_objects.end(),
-                               [](auto &obj)
-                               { return obj->deleted; }),
-                game.game_objects.end());
-            
-            //reset sound_cue bits so no sound events occur it there are no sound events
-            for(auto &g : game.game_objects){
-                g->sound_cues = 0;
-            }
+            // update every match and send its state to its clients:
+            host.tick();
+            server.flush([&](Connection *c, Connection::Event evt)
+                         { host.on_event(c, evt); });
         }
 
         return 0;
@@ -114,8 +114,7 @@ int main(int argc, char **argv) {
 				if (!buffer_vao) return;
 				Mesh const &mesh = buffer->lookup(mesh_name);
 
-				scene.drawables.emplace_back(transform);
-				Scene::Drawable &drawable = scene.drawables.back();
+				Scene::Drawable &drawable = scene.drawables.emplace_back(transform);
 
 				drawable.pipeline = show_scene_program_pipeline;
 